@@ -0,0 +1,279 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+#include "Simd.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace ffmpegUtil {
+
+/*
+ * In place gain kernels for interleaved audio.
+ * The gain ramps linearly from g0 to g1 over the buffer(g0 == g1 for a constant gain),
+ * S16 results are saturated, float results are clamped to [-1, 1].
+ * The best kernel is chosen at compile time: AVX2(-mavx2), SSE2, NEON, or scalar.
+ */
+struct GainKernels {
+  static void scaleS16Scalar(int16_t* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    float g = g0;
+    for (int i = 0; i < count; i++) {
+      float v = s[i] * g;
+      v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+      s[i] = (int16_t)lrintf(v);
+      g += step;
+    }
+  }
+
+  static void scaleFltScalar(float* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    float g = g0;
+    for (int i = 0; i < count; i++) {
+      float v = s[i] * g;
+      s[i] = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+      g += step;
+    }
+  }
+
+  // 32 bit sources(24 bit flac...) are rare, no simd kernel for them.
+  static void scaleS32Scalar(int32_t* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    double g = g0;
+    for (int i = 0; i < count; i++) {
+      double v = s[i] * g;
+      v = v > 2147483647.0 ? 2147483647.0 : (v < -2147483648.0 ? -2147483648.0 : v);
+      s[i] = (int32_t)llrint(v);
+      g += step;
+    }
+  }
+
+#if defined(__AVX2__)
+  static void scaleS16Avx2(int16_t* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    __m256 g = _mm256_add_ps(_mm256_set1_ps(g0),
+                             _mm256_mul_ps(_mm256_set1_ps(step),
+                                           _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 gStep = _mm256_set1_ps(step * 8);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+      __m256i in = _mm256_loadu_si256((const __m256i*)(s + i));
+      __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(in)));
+      __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(in, 1)));
+      lo = _mm256_mul_ps(lo, g);
+      g = _mm256_add_ps(g, gStep);
+      hi = _mm256_mul_ps(hi, g);
+      g = _mm256_add_ps(g, gStep);
+      // packs works per 128 bit lane, restore the order afterwards.
+      __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(lo), _mm256_cvtps_epi32(hi));
+      _mm256_storeu_si256((__m256i*)(s + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    scaleS16Scalar(s + i, count - i, g0 + step * i, g1);
+  }
+
+  static void scaleFltAvx2(float* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    __m256 g = _mm256_add_ps(_mm256_set1_ps(g0),
+                             _mm256_mul_ps(_mm256_set1_ps(step),
+                                           _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 gStep = _mm256_set1_ps(step * 8);
+    __m256 maxV = _mm256_set1_ps(1.0f);
+    __m256 minV = _mm256_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+      __m256 v = _mm256_mul_ps(_mm256_loadu_ps(s + i), g);
+      _mm256_storeu_ps(s + i, _mm256_max_ps(minV, _mm256_min_ps(maxV, v)));
+      g = _mm256_add_ps(g, gStep);
+    }
+    scaleFltScalar(s + i, count - i, g0 + step * i, g1);
+  }
+#endif
+
+#if defined(LP_SIMD_SSE2)
+  static void scaleS16Sse2(int16_t* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    __m128 g = _mm_add_ps(_mm_set1_ps(g0),
+                          _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0, 1, 2, 3)));
+    __m128 gStep = _mm_set1_ps(step * 4);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+      __m128i in = _mm_loadu_si128((const __m128i*)(s + i));
+      // sign extend 16 => 32 without SSE4.1.
+      __m128i lo32 = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+      __m128i hi32 = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+      __m128 lo = _mm_mul_ps(_mm_cvtepi32_ps(lo32), g);
+      g = _mm_add_ps(g, gStep);
+      __m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(hi32), g);
+      g = _mm_add_ps(g, gStep);
+      __m128i out = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+      _mm_storeu_si128((__m128i*)(s + i), out);
+    }
+    scaleS16Scalar(s + i, count - i, g0 + step * i, g1);
+  }
+
+  static void scaleFltSse2(float* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    __m128 g = _mm_add_ps(_mm_set1_ps(g0),
+                          _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0, 1, 2, 3)));
+    __m128 gStep = _mm_set1_ps(step * 4);
+    __m128 maxV = _mm_set1_ps(1.0f);
+    __m128 minV = _mm_set1_ps(-1.0f);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+      __m128 v = _mm_mul_ps(_mm_loadu_ps(s + i), g);
+      _mm_storeu_ps(s + i, _mm_max_ps(minV, _mm_min_ps(maxV, v)));
+      g = _mm_add_ps(g, gStep);
+    }
+    scaleFltScalar(s + i, count - i, g0 + step * i, g1);
+  }
+#endif
+
+#if defined(LP_SIMD_NEON)
+  static void scaleS16Neon(int16_t* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    const float ramp[4] = {0, 1, 2, 3};
+    float32x4_t g = vmlaq_n_f32(vdupq_n_f32(g0), vld1q_f32(ramp), step);
+    float32x4_t gStep = vdupq_n_f32(step * 4);
+    float32x4_t half = vdupq_n_f32(0.5f);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+      int16x8_t in = vld1q_s16(s + i);
+      float32x4_t lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(in))), g);
+      g = vaddq_f32(g, gStep);
+      float32x4_t hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(in))), g);
+      g = vaddq_f32(g, gStep);
+      // round half away from zero, vcvtq truncates.
+      lo = vaddq_f32(lo, vbslq_f32(vcltq_f32(lo, vdupq_n_f32(0)), vnegq_f32(half), half));
+      hi = vaddq_f32(hi, vbslq_f32(vcltq_f32(hi, vdupq_n_f32(0)), vnegq_f32(half), half));
+      int16x8_t out = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(lo)), vqmovn_s32(vcvtq_s32_f32(hi)));
+      vst1q_s16(s + i, out);
+    }
+    scaleS16Scalar(s + i, count - i, g0 + step * i, g1);
+  }
+
+  static void scaleFltNeon(float* s, int count, float g0, float g1) {
+    float step = count > 0 ? (g1 - g0) / count : 0;
+    const float ramp[4] = {0, 1, 2, 3};
+    float32x4_t g = vmlaq_n_f32(vdupq_n_f32(g0), vld1q_f32(ramp), step);
+    float32x4_t gStep = vdupq_n_f32(step * 4);
+    float32x4_t maxV = vdupq_n_f32(1.0f);
+    float32x4_t minV = vdupq_n_f32(-1.0f);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+      float32x4_t v = vmulq_f32(vld1q_f32(s + i), g);
+      vst1q_f32(s + i, vmaxq_f32(minV, vminq_f32(maxV, v)));
+      g = vaddq_f32(g, gStep);
+    }
+    scaleFltScalar(s + i, count - i, g0 + step * i, g1);
+  }
+#endif
+
+  static void scaleS16(int16_t* s, int count, float g0, float g1) {
+#if defined(__AVX2__)
+    scaleS16Avx2(s, count, g0, g1);
+#elif defined(LP_SIMD_SSE2)
+    scaleS16Sse2(s, count, g0, g1);
+#elif defined(LP_SIMD_NEON)
+    scaleS16Neon(s, count, g0, g1);
+#else
+    scaleS16Scalar(s, count, g0, g1);
+#endif
+  }
+
+  static void scaleFlt(float* s, int count, float g0, float g1) {
+#if defined(__AVX2__)
+    scaleFltAvx2(s, count, g0, g1);
+#elif defined(LP_SIMD_SSE2)
+    scaleFltSse2(s, count, g0, g1);
+#elif defined(LP_SIMD_NEON)
+    scaleFltNeon(s, count, g0, g1);
+#else
+    scaleFltScalar(s, count, g0, g1);
+#endif
+  }
+
+  static const char* name() {
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(LP_SIMD_SSE2)
+    return "sse2";
+#elif defined(LP_SIMD_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+  }
+};
+
+/*
+ * Volume, mute and fades for one output stream.
+ * Setters may be called from any thread, apply() runs on the audio callback thread.
+ * Every change of the effective gain is ramped over fadeMs, so there are no clicks.
+ */
+class AudioGain {
+  std::atomic<float> volume{1.0f};
+  std::atomic<bool> muted{false};
+  std::atomic<int> fadeMs{10};
+
+  // only touched by apply().
+  float currentGain = 1.0f;
+
+ public:
+  void setVolume(float v) { volume.store(v < 0 ? 0 : v); }
+  float getVolume() const { return volume.load(); }
+
+  void setMute(bool m) { muted.store(m); }
+  bool isMuted() const { return muted.load(); }
+
+  /*
+   * fade to volume v in ms milliseconds, also the ramp length of later changes.
+   */
+  void fadeTo(float v, int ms) {
+    fadeMs.store(ms < 1 ? 1 : ms);
+    setVolume(v);
+  }
+
+  void apply(uint8_t* data, int bytes, AVSampleFormat format, int channels, int sampleRate) {
+    float target = muted.load() ? 0.0f : volume.load();
+    if (currentGain == 1.0f && target == 1.0f) {
+      return;  // unity gain, nothing to do.
+    }
+
+    int bytesPerSample = av_get_bytes_per_sample(format);
+    int count = bytes / bytesPerSample;
+    int frames = count / channels;
+
+    float endGain = target;
+    if (currentGain != target) {
+      float fadeFrames = (float)fadeMs.load() * sampleRate / 1000;
+      float maxDelta = frames / fadeFrames;
+      float delta = target - currentGain;
+      if (std::fabs(delta) > maxDelta) {
+        endGain = currentGain + (delta > 0 ? maxDelta : -maxDelta);
+      }
+    } else if (target == 0.0f) {
+      std::memset(data, 0, bytes);
+      return;
+    }
+
+    switch (format) {
+      case AV_SAMPLE_FMT_S16:
+        GainKernels::scaleS16((int16_t*)data, count, currentGain, endGain);
+        break;
+      case AV_SAMPLE_FMT_FLT:
+        GainKernels::scaleFlt((float*)data, count, currentGain, endGain);
+        break;
+      case AV_SAMPLE_FMT_S32:
+        GainKernels::scaleS32Scalar((int32_t*)data, count, currentGain, endGain);
+        break;
+      default:
+        // other formats are not produced for the output.
+        break;
+    }
+    currentGain = endGain;
+  }
+};
+
+}  // namespace ffmpegUtil
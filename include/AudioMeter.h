@@ -0,0 +1,369 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+namespace ffmpegUtil {
+
+/*
+ * Metering kernels over blocks of 4 lane frames: every lane is one channel, so the
+ * K-weighting biquads run for 4 channels at once while each channel stays sequential in time.
+ * Per lane they collect the peak, the sum of squares and the K-weighted sum of squares.
+ */
+struct MeterKernels {
+  static const int LANES = 4;
+
+  // transposed direct form II, a0 normalized to 1.
+  struct Biquad {
+    float b0, b1, b2, a1, a2;
+  };
+
+  /*
+   * state: z[0..1] of the shelf and z[2..3] of the high pass, LANES floats each.
+   * acc: peak, sum of squares, K-weighted sum of squares, LANES floats each.
+   */
+  struct Lanes {
+    alignas(16) float z[4][LANES];
+    alignas(16) float acc[3][LANES];
+  };
+
+  static void runScalar(const float* x, int frames, const Biquad& s, const Biquad& h,
+                        Lanes& st) {
+    for (int l = 0; l < LANES; l++) {
+      float z0 = st.z[0][l], z1 = st.z[1][l], z2 = st.z[2][l], z3 = st.z[3][l];
+      float peak = st.acc[0][l], sq = st.acc[1][l], kSq = st.acc[2][l];
+      for (int f = 0; f < frames; f++) {
+        float v = x[f * LANES + l];
+        peak = std::max(peak, std::fabs(v));
+        sq += v * v;
+        float y1 = s.b0 * v + z0;
+        z0 = s.b1 * v - s.a1 * y1 + z1;
+        z1 = s.b2 * v - s.a2 * y1;
+        float y2 = h.b0 * y1 + z2;
+        z2 = h.b1 * y1 - h.a1 * y2 + z3;
+        z3 = h.b2 * y1 - h.a2 * y2;
+        kSq += y2 * y2;
+      }
+      st.z[0][l] = z0, st.z[1][l] = z1, st.z[2][l] = z2, st.z[3][l] = z3;
+      st.acc[0][l] = peak, st.acc[1][l] = sq, st.acc[2][l] = kSq;
+    }
+  }
+
+#if defined(LP_SIMD_SSE2)
+  static void runSse2(const float* x, int frames, const Biquad& s, const Biquad& h,
+                      Lanes& st) {
+    __m128 sb0 = _mm_set1_ps(s.b0), sb1 = _mm_set1_ps(s.b1), sb2 = _mm_set1_ps(s.b2);
+    __m128 sa1 = _mm_set1_ps(s.a1), sa2 = _mm_set1_ps(s.a2);
+    __m128 hb0 = _mm_set1_ps(h.b0), hb1 = _mm_set1_ps(h.b1), hb2 = _mm_set1_ps(h.b2);
+    __m128 ha1 = _mm_set1_ps(h.a1), ha2 = _mm_set1_ps(h.a2);
+    __m128 z0 = _mm_load_ps(st.z[0]), z1 = _mm_load_ps(st.z[1]);
+    __m128 z2 = _mm_load_ps(st.z[2]), z3 = _mm_load_ps(st.z[3]);
+    __m128 peak = _mm_load_ps(st.acc[0]), sq = _mm_load_ps(st.acc[1]);
+    __m128 kSq = _mm_load_ps(st.acc[2]);
+    // clearing the sign bit is the absolute value.
+    __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (int f = 0; f < frames; f++) {
+      __m128 v = _mm_load_ps(x + f * LANES);
+      peak = _mm_max_ps(peak, _mm_and_ps(v, absMask));
+      sq = _mm_add_ps(sq, _mm_mul_ps(v, v));
+      __m128 y1 = _mm_add_ps(_mm_mul_ps(sb0, v), z0);
+      z0 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb1, v), _mm_mul_ps(sa1, y1)), z1);
+      z1 = _mm_sub_ps(_mm_mul_ps(sb2, v), _mm_mul_ps(sa2, y1));
+      __m128 y2 = _mm_add_ps(_mm_mul_ps(hb0, y1), z2);
+      z2 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(hb1, y1), _mm_mul_ps(ha1, y2)), z3);
+      z3 = _mm_sub_ps(_mm_mul_ps(hb2, y1), _mm_mul_ps(ha2, y2));
+      kSq = _mm_add_ps(kSq, _mm_mul_ps(y2, y2));
+    }
+    _mm_store_ps(st.z[0], z0), _mm_store_ps(st.z[1], z1);
+    _mm_store_ps(st.z[2], z2), _mm_store_ps(st.z[3], z3);
+    _mm_store_ps(st.acc[0], peak), _mm_store_ps(st.acc[1], sq), _mm_store_ps(st.acc[2], kSq);
+  }
+#endif
+
+#if defined(LP_SIMD_NEON)
+  static void runNeon(const float* x, int frames, const Biquad& s, const Biquad& h,
+                      Lanes& st) {
+    float32x4_t z0 = vld1q_f32(st.z[0]), z1 = vld1q_f32(st.z[1]);
+    float32x4_t z2 = vld1q_f32(st.z[2]), z3 = vld1q_f32(st.z[3]);
+    float32x4_t peak = vld1q_f32(st.acc[0]), sq = vld1q_f32(st.acc[1]);
+    float32x4_t kSq = vld1q_f32(st.acc[2]);
+    for (int f = 0; f < frames; f++) {
+      float32x4_t v = vld1q_f32(x + f * LANES);
+      peak = vmaxq_f32(peak, vabsq_f32(v));
+      sq = vmlaq_f32(sq, v, v);
+      float32x4_t y1 = vmlaq_n_f32(z0, v, s.b0);
+      z0 = vmlsq_n_f32(vmlaq_n_f32(z1, v, s.b1), y1, s.a1);
+      z1 = vmlsq_n_f32(vmulq_n_f32(v, s.b2), y1, s.a2);
+      float32x4_t y2 = vmlaq_n_f32(z2, y1, h.b0);
+      z2 = vmlsq_n_f32(vmlaq_n_f32(z3, y1, h.b1), y2, h.a1);
+      z3 = vmlsq_n_f32(vmulq_n_f32(y1, h.b2), y2, h.a2);
+      kSq = vmlaq_f32(kSq, y2, y2);
+    }
+    vst1q_f32(st.z[0], z0), vst1q_f32(st.z[1], z1);
+    vst1q_f32(st.z[2], z2), vst1q_f32(st.z[3], z3);
+    vst1q_f32(st.acc[0], peak), vst1q_f32(st.acc[1], sq), vst1q_f32(st.acc[2], kSq);
+  }
+#endif
+
+  static void run(const float* x, int frames, const Biquad& s, const Biquad& h, Lanes& st) {
+#if defined(LP_SIMD_SSE2)
+    runSse2(x, frames, s, h, st);
+#elif defined(LP_SIMD_NEON)
+    runNeon(x, frames, s, h, st);
+#else
+    runScalar(x, frames, s, h, st);
+#endif
+  }
+
+  /*
+   * K-weighting of ITU-R BS.1770 for any sample rate: a high shelf, then a high pass.
+   */
+  static void kWeighting(int sampleRate, Biquad& shelf, Biquad& highPass) {
+    const double pi = 3.14159265358979323846;
+    double f0 = 1681.974450955533;
+    double q = 0.7071752369554196;
+    double k = std::tan(pi * f0 / sampleRate);
+    double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf = Biquad{(float)((vh + vb * k / q + k * k) / a0), (float)(2.0 * (k * k - vh) / a0),
+                   (float)((vh - vb * k / q + k * k) / a0), (float)(2.0 * (k * k - 1.0) / a0),
+                   (float)((1.0 - k / q + k * k) / a0)};
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(pi * f0 / sampleRate);
+    a0 = 1.0 + k / q + k * k;
+    highPass = Biquad{1.0f, -2.0f, 1.0f, (float)(2.0 * (k * k - 1.0) / a0),
+                      (float)((1.0 - k / q + k * k) / a0)};
+  }
+};
+
+// floor of every meter value, also shown for silence.
+const float METER_MIN_DB = -120.0f;
+
+/*
+ * the last published meter values, in dB.
+ */
+struct MeterReading {
+  static const int MAX_CHANNELS = 8;
+  int channels = 0;
+  float peakDb[MAX_CHANNELS];
+  // plain RMS, a full scale sine is -3 dB.
+  float rmsDb[MAX_CHANNELS];
+  // over the last 3 seconds, EBU R128 short-term loudness.
+  float shortTermLufs = 0;
+};
+
+/*
+ * Peak, RMS and short-term loudness of an interleaved stream.
+ * process() runs on the decoder thread, every 100ms of audio a reading is published
+ * lock-free, read() may be called from any thread.
+ */
+class AudioMeter {
+  static const int MAX_CHANNELS = MeterReading::MAX_CHANNELS;
+  static const int GROUPS = MAX_CHANNELS / MeterKernels::LANES;
+  static const int BLOCK_FRAMES = 256;
+  static const int PERIOD_MS = 100;
+  // 3 seconds of 100ms periods.
+  static const int SHORT_TERM_PERIODS = 30;
+
+  int channels = 0;
+  int periodFrames = 0;
+  int framesInPeriod = 0;
+  float weights[MAX_CHANNELS];
+  MeterKernels::Biquad shelf{}, highPass{};
+  MeterKernels::Lanes lanes[GROUPS];
+  // frames of one channel group, LANES floats per frame.
+  alignas(16) float block[BLOCK_FRAMES * MeterKernels::LANES];
+
+  double periodPower[SHORT_TERM_PERIODS];
+  int periodIndex = 0;
+  int periodsFilled = 0;
+
+  std::atomic<bool> enabled{true};
+  // seqlock: odd while a reading is being written.
+  std::atomic<uint32_t> seq{0};
+  std::atomic<int> pubChannels{0};
+  std::atomic<float> pubPeak[MAX_CHANNELS];
+  std::atomic<float> pubRms[MAX_CHANNELS];
+  std::atomic<float> pubLufs{METER_MIN_DB};
+
+  static float toDb(double power) {
+    return power > 0 ? std::max(METER_MIN_DB, (float)(10.0 * std::log10(power)))
+                     : METER_MIN_DB;
+  }
+
+  void clearPeriod() {
+    for (auto& g : lanes) {
+      std::fill(&g.acc[0][0], &g.acc[0][0] + 3 * MeterKernels::LANES, 0.0f);
+    }
+    framesInPeriod = 0;
+  }
+
+  /*
+   * interleaved samples of one channel group into the 4 lane block, missing lanes are 0.
+   */
+  template <typename T>
+  void fillBlock(const T* src, int frames, int group, float scale) {
+    int first = group * MeterKernels::LANES;
+    int n = std::min((int)MeterKernels::LANES, channels - first);
+    for (int f = 0; f < frames; f++) {
+      const T* in = src + f * channels + first;
+      float* out = block + f * MeterKernels::LANES;
+      for (int l = 0; l < MeterKernels::LANES; l++) {
+        out[l] = l < n ? in[l] * scale : 0.0f;
+      }
+    }
+  }
+
+  template <typename T>
+  void processAs(const T* src, int frames, float scale) {
+    while (frames > 0) {
+      int n = std::min(frames, std::min((int)BLOCK_FRAMES, periodFrames - framesInPeriod));
+      for (int g = 0; g * MeterKernels::LANES < channels; g++) {
+        fillBlock(src, n, g, scale);
+        MeterKernels::run(block, n, shelf, highPass, lanes[g]);
+      }
+      src += n * channels;
+      frames -= n;
+      framesInPeriod += n;
+      if (framesInPeriod == periodFrames) {
+        publish();
+      }
+    }
+  }
+
+  void publish() {
+    double power = 0;
+    for (int c = 0; c < channels; c++) {
+      auto& g = lanes[c / MeterKernels::LANES];
+      power += weights[c] * g.acc[2][c % MeterKernels::LANES] / framesInPeriod;
+    }
+    periodPower[periodIndex] = power;
+    periodIndex = (periodIndex + 1) % SHORT_TERM_PERIODS;
+    periodsFilled = std::min(periodsFilled + 1, (int)SHORT_TERM_PERIODS);
+    double mean = 0;
+    for (int i = 0; i < periodsFilled; i++) {
+      mean += periodPower[i];
+    }
+    mean /= periodsFilled;
+
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    pubChannels.store(channels, std::memory_order_relaxed);
+    for (int c = 0; c < channels; c++) {
+      auto& g = lanes[c / MeterKernels::LANES];
+      int l = c % MeterKernels::LANES;
+      float peak = g.acc[0][l];
+      pubPeak[c].store(toDb((double)peak * peak), std::memory_order_relaxed);
+      pubRms[c].store(toDb(g.acc[1][l] / framesInPeriod), std::memory_order_relaxed);
+    }
+    pubLufs.store(mean > 0 ? std::max(METER_MIN_DB, (float)(-0.691 + 10.0 * std::log10(mean)))
+                           : METER_MIN_DB,
+                  std::memory_order_relaxed);
+    seq.store(s + 2, std::memory_order_release);
+
+    // a silent tail leaves denormals in the filter state, they are very slow on x86.
+    for (auto& g : lanes) {
+      for (auto& z : g.z) {
+        for (auto& v : z) {
+          v = std::fabs(v) < 1e-15f ? 0.0f : v;
+        }
+      }
+    }
+    clearPeriod();
+  }
+
+ public:
+  AudioMeter() {
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+      pubPeak[c].store(METER_MIN_DB);
+      pubRms[c].store(METER_MIN_DB);
+    }
+  }
+  AudioMeter(const AudioMeter&) = delete;
+  AudioMeter& operator=(const AudioMeter&) = delete;
+
+  /*
+   * start over for a new stream format, channels above 8 are not metered.
+   */
+  void configure(int ch, int sampleRate) {
+    channels = std::min(ch, (int)MAX_CHANNELS);
+    periodFrames = std::max(1, sampleRate * PERIOD_MS / 1000);
+    MeterKernels::kWeighting(sampleRate, shelf, highPass);
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+      // BS.1770 weights for 5.1: LFE is left out, the surrounds count +1.5dB.
+      weights[c] = 1.0f;
+      if (channels == 6) {
+        weights[c] = c == 3 ? 0.0f : (c >= 4 ? 1.41f : 1.0f);
+      }
+    }
+    for (auto& g : lanes) {
+      std::fill(&g.z[0][0], &g.z[0][0] + 4 * MeterKernels::LANES, 0.0f);
+    }
+    periodIndex = 0;
+    periodsFilled = 0;
+    clearPeriod();
+  }
+
+  void setEnabled(bool e) { enabled.store(e); }
+  bool isEnabled() const { return enabled.load(); }
+
+  /*
+   * meter frames of interleaved S16, S32 or FLT audio.
+   */
+  void process(const uint8_t* data, int frames, AVSampleFormat format) {
+    if (!enabled.load() || channels <= 0 || frames <= 0) {
+      return;
+    }
+    switch (format) {
+      case AV_SAMPLE_FMT_S16:
+        processAs((const int16_t*)data, frames, 1.0f / 32768);
+        break;
+      case AV_SAMPLE_FMT_S32:
+        processAs((const int32_t*)data, frames, 1.0f / 2147483648.0f);
+        break;
+      case AV_SAMPLE_FMT_FLT:
+        processAs((const float*)data, frames, 1.0f);
+        break;
+      default:
+        // other formats are not produced for the output.
+        break;
+    }
+  }
+
+  /*
+   *  return
+   *          false when nothing has been published yet.
+   */
+  bool read(MeterReading& r) const {
+    while (true) {
+      uint32_t s1 = seq.load(std::memory_order_acquire);
+      if (s1 == 0) {
+        return false;
+      }
+      if (s1 & 1) {
+        continue;
+      }
+      r.channels = pubChannels.load(std::memory_order_relaxed);
+      for (int c = 0; c < r.channels; c++) {
+        r.peakDb[c] = pubPeak[c].load(std::memory_order_relaxed);
+        r.rmsDb[c] = pubRms[c].load(std::memory_order_relaxed);
+      }
+      r.shortTermLufs = pubLufs.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq.load(std::memory_order_relaxed) == s1) {
+        return true;
+      }
+    }
+  }
+};
+
+}  // namespace ffmpegUtil
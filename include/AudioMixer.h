@@ -0,0 +1,206 @@
+#pragma once
+
+#include "AudioSink.h"
+#include "MediaProcessor.hpp"
+#include "ThreadPolicy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include "SDL/SDL.h"
+};
+
+/*
+ * One audio device for many players: every input pulls from its own AudioProcessor, the
+ * callback sums them at 1/sqrt(n) of n attached inputs, so unrelated sources keep about
+ * the loudness of one and rarely clip. The device runs float stereo at a fixed rate, each
+ * processor converts to it, so nothing is reopened when a source comes or goes.
+ */
+class AudioMixer {
+ public:
+  static const int MIX_RATE = 48000;
+  static const int MIX_CHANNELS = 2;
+  static const int DEVICE_SAMPLES = 1024;
+
+  /*
+   * AudioSink of one player, the clock is the position of its own source.
+   */
+  class Input : public AudioSink {
+    AudioMixer& mixer;
+    std::atomic<AudioProcessor*> source{nullptr};
+    // a paused input is not pulled, the others play on.
+    std::atomic<bool> paused{false};
+    friend class AudioMixer;
+
+   public:
+    explicit Input(AudioMixer& m) : mixer(m) {}
+
+    const char* getName() const override { return "mixer"; }
+
+    void attach(AudioProcessor& aProcessor) override {
+      aProcessor.setOutputAudio(mixer.mixAudio, mixer.samples, mixer.queueSamples);
+      SDL_LockAudioDevice(mixer.audioDeviceID);
+      source.store(&aProcessor);
+      SDL_UnlockAudioDevice(mixer.audioDeviceID);
+    }
+
+    void detach() override {
+      SDL_LockAudioDevice(mixer.audioDeviceID);
+      source.store(nullptr);
+      SDL_UnlockAudioDevice(mixer.audioDeviceID);
+    }
+
+    // the device belongs to the mixer.
+    void close() override { detach(); }
+
+    void setPaused(bool p) override { paused.store(p); }
+
+    uint64_t getClockMs() override {
+      AudioProcessor* receiver = source.load();
+      return receiver != nullptr ? receiver->getPts() : 0;
+    }
+  };
+
+ private:
+  SDL_AudioDeviceID audioDeviceID = 0;
+  ffmpegUtil::AudioInfo mixAudio{};
+  int samples = DEVICE_SAMPLES;
+  int queueSamples = DEVICE_SAMPLES;
+  // inputs are only added or removed with the callback locked out.
+  std::vector<std::unique_ptr<Input>> inputs{};
+  // one source at a time is pulled into it, sized when the device is opened.
+  std::vector<float> scratch{};
+  std::atomic<int64_t> clipped{0};
+
+  static void callback(void* userdata, Uint8* stream, int len) {
+    ThreadPolicy::shared().applyOnce("lp-audio-mix", ThreadRole::AUDIO);
+    ((AudioMixer*)userdata)->mix((float*)stream, len / (int)sizeof(float));
+  }
+
+  void mix(float* out, int count) {
+    std::fill(out, out + count, 0.0f);
+    if ((int)scratch.size() < count) {
+      // never expected, SDL keeps the size it opened with.
+      return;
+    }
+    // paused inputs count too, pausing one does not change the level of the others.
+    int attached = 0;
+    for (auto& input : inputs) {
+      if (input->source.load() != nullptr) {
+        attached++;
+      }
+    }
+    float headroom = attached > 1 ? 1.0f / std::sqrt((float)attached) : 1.0f;
+    uint8_t* data = reinterpret_cast<uint8_t*>(scratch.data());
+    for (auto& input : inputs) {
+      AudioProcessor* receiver = input->source.load();
+      if (receiver == nullptr || input->paused.load()) {
+        continue;
+      }
+      // volume and mute are applied by the source.
+      receiver->writeAudioData(data, count * (int)sizeof(float));
+      for (int i = 0; i < count; i++) {
+        out[i] += scratch[i] * headroom;
+      }
+    }
+    int64_t clips = 0;
+    for (int i = 0; i < count; i++) {
+      if (out[i] > 1.0f || out[i] < -1.0f) {
+        out[i] = out[i] > 0 ? 1.0f : -1.0f;
+        clips++;
+      }
+    }
+    if (clips > 0) {
+      clipped += clips;
+    }
+  }
+
+ public:
+  /*
+   * latencyMs: audio each source keeps decoded on top of the device buffer,
+   * 0 for one device buffer.
+   */
+  explicit AudioMixer(int latencyMs = 0) {
+    SDL_AudioSpec wanted_specs;
+    SDL_AudioSpec specs;
+    SDL_zero(wanted_specs);
+    wanted_specs.freq = MIX_RATE;
+    wanted_specs.format = AUDIO_F32SYS;
+    wanted_specs.channels = MIX_CHANNELS;
+    wanted_specs.samples = DEVICE_SAMPLES;
+    wanted_specs.callback = callback;
+    wanted_specs.userdata = this;
+    // no format changes allowed, SDL converts for the device if needed.
+    audioDeviceID = SDL_OpenAudioDevice(nullptr, 0, &wanted_specs, &specs, 0);
+    if (audioDeviceID == 0) {
+      string errMsg = "Failed to open mixer audio device:";
+      errMsg += SDL_GetError();
+      cout << errMsg << endl;
+      throw std::runtime_error(errMsg);
+    }
+    mixAudio = ffmpegUtil::AudioInfo(AV_CH_LAYOUT_STEREO, specs.freq, specs.channels,
+                                     AV_SAMPLE_FMT_FLT);
+    samples = specs.samples;
+    queueSamples = std::max(samples, (int)((int64_t)specs.freq * latencyMs / 1000));
+    scratch.assign((size_t)samples * specs.channels, 0.0f);
+    cout << "AudioMixer: rate=" << specs.freq << ", device buffer=" << samples
+         << " samples, queue=" << queueSamples << " samples" << endl;
+    SDL_PauseAudioDevice(audioDeviceID, 0);
+  }
+
+  /*
+   * the mixer of a wall, or null to play without sound: an offscreen wall opens no device,
+   * and a host without one still plays the video.
+   */
+  static std::unique_ptr<AudioMixer> openOptional(bool wanted, int latencyMs) {
+    if (!wanted) {
+      cout << "AudioMixer: not opened, the audio is not played." << endl;
+      return nullptr;
+    }
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+      cout << "WARN: no SDL audio, the audio is not played: " << SDL_GetError() << endl;
+      return nullptr;
+    }
+    try {
+      return std::unique_ptr<AudioMixer>{new AudioMixer(latencyMs)};
+    } catch (const std::runtime_error&) {
+      cout << "WARN: the audio is not played." << endl;
+      return nullptr;
+    }
+  }
+
+  AudioMixer(const AudioMixer&) = delete;
+  AudioMixer& operator=(const AudioMixer&) = delete;
+
+  // the inputs must be detached already, their sources may be gone.
+  ~AudioMixer() {
+    SDL_PauseAudioDevice(audioDeviceID, 1);
+    SDL_CloseAudioDevice(audioDeviceID);
+    cout << "AudioMixer closed, clipped samples=" << clipped.load() << endl;
+  }
+
+  Input& addInput() {
+    std::unique_ptr<Input> input{new Input(*this)};
+    SDL_LockAudioDevice(audioDeviceID);
+    inputs.push_back(std::move(input));
+    SDL_UnlockAudioDevice(audioDeviceID);
+    return *inputs.back();
+  }
+
+  // an input whose player could not be opened, nothing is attached to it.
+  void removeInput(AudioSink* sink) {
+    SDL_LockAudioDevice(audioDeviceID);
+    inputs.erase(std::remove_if(inputs.begin(), inputs.end(),
+                                [sink](const std::unique_ptr<Input>& in) {
+                                  return in.get() == sink;
+                                }),
+                 inputs.end());
+    SDL_UnlockAudioDevice(audioDeviceID);
+  }
+
+  int64_t getClippedSamples() const { return clipped.load(); }
+};
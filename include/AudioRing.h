@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace ffmpegUtil {
+
+/*
+ * Lock-free single producer / single consumer ring of trivially copyable items.
+ * The decoder thread pushes, the audio callback pops, neither of them ever blocks.
+ * clear() and reset() are only allowed while no one is pushing or popping.
+ */
+template <typename T>
+class SpscRing {
+  std::vector<T> items{};
+  size_t mask = 0;
+  // positions grow forever, the index is pos & mask.
+  std::atomic<size_t> readPos{0};
+  std::atomic<size_t> writePos{0};
+
+ public:
+  SpscRing() = default;
+  explicit SpscRing(size_t minCapacity) { reset(minCapacity); }
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  /*
+   * capacity is rounded up to a power of two, the content is dropped.
+   */
+  void reset(size_t minCapacity) {
+    size_t capacity = 1;
+    while (capacity < minCapacity) {
+      capacity <<= 1;
+    }
+    items.assign(capacity, T{});
+    mask = capacity - 1;
+    clear();
+  }
+
+  void clear() {
+    readPos.store(0);
+    writePos.store(0);
+  }
+
+  size_t capacity() const { return items.size(); }
+
+  size_t size() const { return writePos.load(std::memory_order_acquire) - readPos.load(); }
+
+  /*
+   *  return
+   *          items pushed, less than count when the ring is full.
+   */
+  size_t push(const T* src, size_t count) {
+    size_t w = writePos.load(std::memory_order_relaxed);
+    size_t r = readPos.load(std::memory_order_acquire);
+    count = std::min(count, items.size() - (w - r));
+    size_t first = std::min(count, items.size() - (w & mask));
+    std::memcpy(&items[w & mask], src, first * sizeof(T));
+    std::memcpy(&items[0], src + first, (count - first) * sizeof(T));
+    writePos.store(w + count, std::memory_order_release);
+    return count;
+  }
+
+  /*
+   *  return
+   *          items popped, less than count when the ring runs empty.
+   */
+  size_t pop(T* dst, size_t count) {
+    size_t r = readPos.load(std::memory_order_relaxed);
+    size_t w = writePos.load(std::memory_order_acquire);
+    count = std::min(count, w - r);
+    size_t first = std::min(count, items.size() - (r & mask));
+    std::memcpy(dst, &items[r & mask], first * sizeof(T));
+    std::memcpy(dst + first, &items[0], (count - first) * sizeof(T));
+    readPos.store(r + count, std::memory_order_release);
+    return count;
+  }
+
+  bool push(const T& item) { return push(&item, 1) == 1; }
+
+  bool peek(T& item) const {
+    size_t r = readPos.load(std::memory_order_relaxed);
+    if (writePos.load(std::memory_order_acquire) == r) {
+      return false;
+    }
+    item = items[r & mask];
+    return true;
+  }
+
+  bool pop(T& item) { return pop(&item, 1) == 1; }
+};
+
+}  // namespace ffmpegUtil
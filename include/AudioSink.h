@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+class AudioProcessor;
+
+/*
+ * Audio output backend. It pulls the decoded audio of the attached AudioProcessor
+ * (writeAudioData) and tells where the playback is.
+ */
+class AudioSink {
+ public:
+  virtual ~AudioSink() {}
+
+  virtual const char* getName() const = 0;
+
+  /*
+   * switch to a new source, the device is reopened only when it can not take it.
+   */
+  virtual void attach(AudioProcessor& aProcessor) = 0;
+
+  /*
+   * stop pulling from the source before it is destroyed, the device plays silence.
+   */
+  virtual void detach() = 0;
+
+  virtual void close() = 0;
+
+  /*
+   * hold the device, the queued audio is kept and plays on at once on resume.
+   */
+  virtual void setPaused(bool paused) = 0;
+
+  /*
+   * playback position of the attached source in ms, the audio clock for video sync.
+   */
+  virtual uint64_t getClockMs() = 0;
+
+  // backend specific counters, for comparing the backends.
+  virtual void printStats() {}
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#ifdef __cplusplus
+};
+#endif
+
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace ffmpegUtil {
+
+/*
+ * Time stretch of interleaved audio with the atempo filter, the pitch is kept.
+ * Sits after the ReSampler, in and out are the same format.
+ */
+class AudioTempo {
+  AVFilterGraph* graph = nullptr;
+  AVFilterContext* srcCtx = nullptr;
+  AVFilterContext* sinkCtx = nullptr;
+  AVFrame* outFrame = nullptr;
+  int64_t nextPts = 0;
+  // stream ms of the first input and the samples put out since, see outputEndMs.
+  double inputStartMs = -1;
+  int64_t samplesOut = 0;
+
+  void freeGraph() {
+    if (outFrame != nullptr) {
+      av_frame_free(&outFrame);
+    }
+    if (graph != nullptr) {
+      avfilter_graph_free(&graph);
+    }
+  }
+
+  template <typename Consumer>
+  void pull(Consumer& consume) {
+    while (av_buffersink_get_frame(sinkCtx, outFrame) >= 0) {
+      int bytes = av_samples_get_buffer_size(nullptr, audio.channels, outFrame->nb_samples,
+                                             audio.format, 1);
+      samplesOut += outFrame->nb_samples;
+      consume(outFrame->data[0], bytes, outputEndMs());
+      av_frame_unref(outFrame);
+    }
+  }
+
+  void check(int ret, const string& what) {
+    if (ret < 0) {
+      freeGraph();
+      throw std::runtime_error("AudioTempo: " + what + " failed, ret=" + std::to_string(ret));
+    }
+  }
+
+ public:
+  static constexpr double MIN_TEMPO = 0.5;
+  static constexpr double MAX_TEMPO = 4.0;
+
+  const AudioInfo audio;
+  const double tempo;
+
+  /*
+   * one atempo instance only stretches between 0.5 and 2.0 in older FFmpeg, chain them.
+   */
+  static string filterChain(double t) {
+    stringstream ss{};
+    while (t > 2.0) {
+      ss << "atempo=2.0,";
+      t /= 2.0;
+    }
+    ss << "atempo=" << t;
+    return ss.str();
+  }
+
+  AudioTempo(const AudioInfo& a, double t) : audio(a), tempo(t) {
+    graph = avfilter_graph_alloc();
+    outFrame = av_frame_alloc();
+    if (graph == nullptr || outFrame == nullptr) {
+      freeGraph();
+      throw std::runtime_error("AudioTempo: alloc failed.");
+    }
+
+    const char* fmtName = av_get_sample_fmt_name(audio.format);
+    stringstream args{};
+    args << "time_base=1/" << audio.sampleRate << ":sample_rate=" << audio.sampleRate
+         << ":sample_fmt=" << fmtName << ":channel_layout=0x" << std::hex << audio.layout;
+    check(avfilter_graph_create_filter(&srcCtx, avfilter_get_by_name("abuffer"), "in",
+                                       args.str().c_str(), nullptr, graph),
+          "abuffer");
+    check(avfilter_graph_create_filter(&sinkCtx, avfilter_get_by_name("abuffersink"), "out",
+                                       nullptr, nullptr, graph),
+          "abuffersink");
+
+    // atempo may pick a planar format internally, convert back to what the device takes.
+    stringstream chain{};
+    chain << filterChain(tempo) << ",aformat=sample_fmts=" << fmtName
+          << ":channel_layouts=0x" << std::hex << audio.layout;
+
+    AVFilterInOut* outputs = avfilter_inout_alloc();
+    AVFilterInOut* inputs = avfilter_inout_alloc();
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = srcCtx;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = sinkCtx;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
+    int ret = avfilter_graph_parse_ptr(graph, chain.str().c_str(), &inputs, &outputs, nullptr);
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    check(ret, "parse " + chain.str());
+    check(avfilter_graph_config(graph, nullptr), "config");
+    cout << "AudioTempo: " << chain.str() << endl;
+  }
+
+  AudioTempo(const AudioTempo&) = delete;
+  AudioTempo& operator=(const AudioTempo&) = delete;
+
+  ~AudioTempo() { freeGraph(); }
+
+  /*
+   * the stream position(ms) the output has reached. Every output ms holds tempo ms of the
+   * stream from the first input on, the window kept back is not counted until it is out.
+   */
+  double outputEndMs() const {
+    return inputStartMs + samplesOut * 1000.0 / audio.sampleRate * tempo;
+  }
+
+  /*
+   * stretch samples of interleaved data starting at startMs of the stream,
+   * consume(data, bytes, outputEndMs) gets every output chunk.
+   * The filter keeps a window of audio back, the output lags the input by that much.
+   */
+  template <typename Consumer>
+  void process(const uint8_t* data, int samples, double startMs, Consumer&& consume) {
+    if (inputStartMs < 0) {
+      inputStartMs = startMs;
+    }
+    AVFrame* in = av_frame_alloc();
+    in->nb_samples = samples;
+    in->format = audio.format;
+    in->channel_layout = audio.layout;
+    in->channels = audio.channels;
+    in->sample_rate = audio.sampleRate;
+    in->pts = nextPts;
+    nextPts += samples;
+    if (av_frame_get_buffer(in, 0) < 0) {
+      av_frame_free(&in);
+      throw std::runtime_error("AudioTempo: av_frame_get_buffer failed.");
+    }
+    std::memcpy(in->data[0], data,
+                av_samples_get_buffer_size(nullptr, audio.channels, samples, audio.format, 1));
+    // the filter takes over the buffer reference.
+    int ret = av_buffersrc_add_frame(srcCtx, in);
+    av_frame_free(&in);
+    if (ret < 0) {
+      throw std::runtime_error("AudioTempo: av_buffersrc_add_frame failed, ret=" +
+                               std::to_string(ret));
+    }
+
+    pull(consume);
+  }
+
+  /*
+   * end of the input, the window the filter keeps back goes to consume.
+   * Nothing can be processed afterwards, a new tempo gets a new filter.
+   */
+  template <typename Consumer>
+  void drain(Consumer&& consume) {
+    if (av_buffersrc_add_frame(srcCtx, nullptr) < 0) {
+      return;
+    }
+    pull(consume);
+  }
+
+  static double clamp(double t) {
+    if (std::isnan(t)) {
+      return 1.0;
+    }
+    if (t < MIN_TEMPO) {
+      return MIN_TEMPO;
+    }
+    return t > MAX_TEMPO ? MAX_TEMPO : t;
+  }
+};
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,318 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/channel_layout.h>
+#ifdef __cplusplus
+};
+#endif
+
+#include "Simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace ffmpegUtil {
+
+/*
+ * Mixing coefficients from the channels of inLayout to the channels of outLayout,
+ * row major: coeffs[out * inChannels + in], in the channel order of FFmpeg.
+ * Built for mono and stereo outputs, the targets of a downmix to a playback device.
+ */
+struct DownmixMatrix {
+  std::string mode;
+  int64_t inLayout = 0;
+  int64_t outLayout = 0;
+  int inChannels = 0;
+  int outChannels = 0;
+  std::vector<double> coeffs{};
+
+  /*
+   * mode:
+   *        "itu"    : ITU-R BS.775, centre and surrounds at -3dB, LFE dropped
+   *        "dolby"  : Dolby Pro Logic II matrix encoding of the surrounds
+   *        "c,c,..;c,c,..": custom, one row per output channel
+   *        "" or "default": nullptr, swr's own downmix
+   * itu and dolby are normalized so no output can clip, a custom matrix is taken as is.
+   * Matrices are built once per (mode, inLayout, outLayout) and shared.
+   *  return
+   *          nullptr when there is nothing to downmix or no matrix for the layouts.
+   */
+  static std::shared_ptr<const DownmixMatrix> get(const std::string& mode, int64_t inLayout,
+                                                  int64_t outLayout) {
+    if (mode.empty() || mode == "default" || inLayout <= 0 || outLayout <= 0) {
+      return nullptr;
+    }
+    static std::mutex cacheMutex{};
+    static std::map<std::tuple<std::string, int64_t, int64_t>,
+                    std::shared_ptr<const DownmixMatrix>>
+        cache{};
+    std::lock_guard<std::mutex> lg{cacheMutex};
+    auto key = std::make_tuple(mode, inLayout, outLayout);
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+      return it->second;
+    }
+    auto matrix = build(mode, inLayout, outLayout);
+    cache[key] = matrix;
+    return matrix;
+  }
+
+  double at(int out, int in) const { return coeffs[out * inChannels + in]; }
+
+ private:
+  // index of a channel in the layout, -1 if it is not there.
+  static int indexOf(int64_t layout, uint64_t channel) {
+    if (!(layout & channel)) {
+      return -1;
+    }
+    return av_get_channel_layout_nb_channels(layout & (channel - 1));
+  }
+
+  void add(int out, uint64_t channel, double c) {
+    int in = indexOf(inLayout, channel);
+    if (in >= 0) {
+      coeffs[out * inChannels + in] += c;
+    }
+  }
+
+  // left and right of a stereo downmix, the mono one is their average.
+  void buildStereo(bool dolby) {
+    const double m3dB = 0.70710678118654752;
+    const int l = 0, r = outChannels > 1 ? 1 : 0;
+    add(l, AV_CH_FRONT_LEFT, 1);
+    add(r, AV_CH_FRONT_RIGHT, 1);
+    add(l, AV_CH_FRONT_LEFT_OF_CENTER, 1);
+    add(r, AV_CH_FRONT_RIGHT_OF_CENTER, 1);
+    add(l, AV_CH_FRONT_CENTER, m3dB);
+    add(r, AV_CH_FRONT_CENTER, m3dB);
+    // the surround pair is the side pair of 5.1 and the back pair of 5.1(back).
+    const uint64_t surrounds[2][2] = {{AV_CH_SIDE_LEFT, AV_CH_SIDE_RIGHT},
+                                      {AV_CH_BACK_LEFT, AV_CH_BACK_RIGHT}};
+    for (auto& s : surrounds) {
+      if (dolby) {
+        // Pro Logic II: the surrounds go in with opposite phase, a decoder steers them back.
+        add(l, s[0], -0.8660);
+        add(l, s[1], -0.5);
+        add(r, s[0], 0.5);
+        add(r, s[1], 0.8660);
+      } else {
+        add(l, s[0], m3dB);
+        add(r, s[1], m3dB);
+      }
+    }
+    add(l, AV_CH_BACK_CENTER, dolby ? -m3dB : 0.5);
+    add(r, AV_CH_BACK_CENTER, dolby ? m3dB : 0.5);
+    // LFE is not part of a downmix.
+  }
+
+  static void parseCustom(const std::string& mode, DownmixMatrix& m) {
+    std::stringstream rows{mode};
+    std::string row;
+    int out = 0;
+    while (std::getline(rows, row, ';')) {
+      std::stringstream values{row};
+      std::string value;
+      int in = 0;
+      while (std::getline(values, value, ',')) {
+        if (out >= m.outChannels || in >= m.inChannels) {
+          throw std::runtime_error("downmix matrix: too many values in " + mode);
+        }
+        m.coeffs[out * m.inChannels + in] = std::atof(value.c_str());
+        in++;
+      }
+      if (in != m.inChannels) {
+        throw std::runtime_error("downmix matrix: row " + std::to_string(out) + " needs " +
+                                 std::to_string(m.inChannels) + " values: " + mode);
+      }
+      out++;
+    }
+    if (out != m.outChannels) {
+      throw std::runtime_error("downmix matrix: needs " + std::to_string(m.outChannels) +
+                               " rows: " + mode);
+    }
+  }
+
+  // scale so that no row can exceed full scale.
+  void normalize() {
+    double maxSum = 0;
+    for (int o = 0; o < outChannels; o++) {
+      double sum = 0;
+      for (int i = 0; i < inChannels; i++) {
+        sum += std::fabs(at(o, i));
+      }
+      maxSum = std::max(maxSum, sum);
+    }
+    if (maxSum > 1.0) {
+      for (auto& c : coeffs) {
+        c /= maxSum;
+      }
+    }
+  }
+
+  static std::shared_ptr<const DownmixMatrix> build(const std::string& mode, int64_t inLayout,
+                                                    int64_t outLayout) {
+    std::shared_ptr<DownmixMatrix> m{new DownmixMatrix()};
+    m->mode = mode;
+    m->inLayout = inLayout;
+    m->outLayout = outLayout;
+    m->inChannels = av_get_channel_layout_nb_channels(inLayout);
+    m->outChannels = av_get_channel_layout_nb_channels(outLayout);
+    if (m->outChannels >= m->inChannels) {
+      return nullptr;
+    }
+    m->coeffs.assign((size_t)m->inChannels * m->outChannels, 0.0);
+
+    if (mode == "itu" || mode == "dolby") {
+      if (outLayout != AV_CH_LAYOUT_STEREO && outLayout != AV_CH_LAYOUT_MONO) {
+        return nullptr;
+      }
+      m->buildStereo(mode == "dolby");
+      if (m->outChannels == 1) {
+        // both halves were added to row 0, the average keeps the level.
+        for (auto& c : m->coeffs) {
+          c *= 0.5;
+        }
+      }
+      m->normalize();
+    } else {
+      parseCustom(mode, *m);
+    }
+    return m;
+  }
+};
+
+/*
+ * Downmix of planar float input to interleaved float output, the common case of
+ * AAC, AC-3 and DTS decoders feeding a stereo device.
+ * Vectorized over frames: every coefficient is one broadcast, every input channel one
+ * contiguous load per 4(SSE2, NEON) or 8(AVX2) frames.
+ */
+struct DownmixKernels {
+  static const int MAX_IN = 16;
+
+  static void mixScalar(const float* const* in, int inCh, int frames, float* out, int outCh,
+                        const float* m) {
+    for (int f = 0; f < frames; f++) {
+      for (int o = 0; o < outCh; o++) {
+        float acc = 0;
+        for (int i = 0; i < inCh; i++) {
+          acc += m[o * inCh + i] * in[i][f];
+        }
+        out[f * outCh + o] = acc;
+      }
+    }
+  }
+
+#if defined(__AVX2__)
+  static int mixAvx2(const float* const* in, int inCh, int frames, float* out, int outCh,
+                     const float* m) {
+    int f = 0;
+    for (; f + 8 <= frames; f += 8) {
+      __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+      for (int i = 0; i < inCh; i++) {
+        __m256 v = _mm256_loadu_ps(in[i] + f);
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_set1_ps(m[i]), v));
+        if (outCh == 2) {
+          acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_set1_ps(m[inCh + i]), v));
+        }
+      }
+      if (outCh == 1) {
+        _mm256_storeu_ps(out + f, acc0);
+      } else {
+        // unpack interleaves within 128 bit lanes, put the halves in frame order.
+        __m256 lo = _mm256_unpacklo_ps(acc0, acc1);
+        __m256 hi = _mm256_unpackhi_ps(acc0, acc1);
+        _mm256_storeu_ps(out + f * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + f * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+      }
+    }
+    return f;
+  }
+#endif
+
+#if defined(LP_SIMD_SSE2)
+  static int mixSse2(const float* const* in, int inCh, int frames, float* out, int outCh,
+                     const float* m) {
+    int f = 0;
+    for (; f + 4 <= frames; f += 4) {
+      __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+      for (int i = 0; i < inCh; i++) {
+        __m128 v = _mm_loadu_ps(in[i] + f);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_set1_ps(m[i]), v));
+        if (outCh == 2) {
+          acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_set1_ps(m[inCh + i]), v));
+        }
+      }
+      if (outCh == 1) {
+        _mm_storeu_ps(out + f, acc0);
+      } else {
+        _mm_storeu_ps(out + f * 2, _mm_unpacklo_ps(acc0, acc1));
+        _mm_storeu_ps(out + f * 2 + 4, _mm_unpackhi_ps(acc0, acc1));
+      }
+    }
+    return f;
+  }
+#endif
+
+#if defined(LP_SIMD_NEON)
+  static int mixNeon(const float* const* in, int inCh, int frames, float* out, int outCh,
+                     const float* m) {
+    int f = 0;
+    for (; f + 4 <= frames; f += 4) {
+      float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+      for (int i = 0; i < inCh; i++) {
+        float32x4_t v = vld1q_f32(in[i] + f);
+        acc0 = vmlaq_n_f32(acc0, v, m[i]);
+        if (outCh == 2) {
+          acc1 = vmlaq_n_f32(acc1, v, m[inCh + i]);
+        }
+      }
+      if (outCh == 1) {
+        vst1q_f32(out + f, acc0);
+      } else {
+        float32x4x2_t lr = {{acc0, acc1}};
+        vst2q_f32(out + f * 2, lr);
+      }
+    }
+    return f;
+  }
+#endif
+
+  /*
+   * m: outCh rows of inCh float coefficients, outCh 1 or 2 for the simd kernels.
+   */
+  static void mix(const float* const* in, int inCh, int frames, float* out, int outCh,
+                  const float* m) {
+    int done = 0;
+    if (outCh <= 2) {
+#if defined(__AVX2__)
+      done = mixAvx2(in, inCh, frames, out, outCh, m);
+#elif defined(LP_SIMD_SSE2)
+      done = mixSse2(in, inCh, frames, out, outCh, m);
+#elif defined(LP_SIMD_NEON)
+      done = mixNeon(in, inCh, frames, out, outCh, m);
+#endif
+    }
+    if (done < frames) {
+      const float* rest[MAX_IN];
+      for (int i = 0; i < inCh; i++) {
+        rest[i] = in[i] + done;
+      }
+      mixScalar(rest, inCh, frames - done, out + done * outCh, outCh, m);
+    }
+  }
+};
+
+}  // namespace ffmpegUtil
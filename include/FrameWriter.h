@@ -0,0 +1,324 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ffmpegUtil {
+
+struct YuvWriterOptions {
+  // write a Y4M stream header and frame headers, raw planes only otherwise.
+  bool y4m = true;
+  // O_DIRECT, bypass the page cache.
+  bool directIo = false;
+  size_t bufferBytes = 32 << 20;
+  int bufferCount = 3;
+};
+
+/*
+ * Raw yuv420p / Y4M writer for dumping decoded sequences.
+ *
+ * Frames are packed into large aligned buffers, full buffers are written by a background
+ * thread with one write call each, so the decoding thread only pays for the memcpy.
+ * With directIo the file is opened with O_DIRECT(linux), bypassing the page cache,
+ * the buffers are page aligned and written in page multiples for that.
+ */
+class YuvFrameWriter {
+  static const size_t ALIGNMENT = 4096;
+
+  struct Buffer {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+  };
+
+  const string path;
+  const int width;
+  const int height;
+  const YuvWriterOptions options;
+  size_t capacity = 0;
+
+#ifdef _WIN32
+  FILE* file = nullptr;
+#else
+  int fd = -1;
+#endif
+  // decided when the file is opened, never changed afterwards.
+  bool directIo = false;
+
+  std::vector<uint8_t*> allBuffers{};
+  Buffer current{};
+  std::deque<Buffer> freeBuffers{};
+  std::deque<Buffer> fullBuffers{};
+  std::mutex mtx{};
+  std::condition_variable cv{};
+  bool stopping = false;
+  bool failed = false;
+  std::thread writerThread{};
+
+  int64_t framesWritten = 0;
+  int64_t bytesWritten = 0;
+
+  static uint8_t* alignedAlloc(size_t size) {
+#ifdef _WIN32
+    return (uint8_t*)_aligned_malloc(size, ALIGNMENT);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, ALIGNMENT, size) == 0 ? (uint8_t*)p : nullptr;
+#endif
+  }
+
+  static void alignedFree(uint8_t* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+  }
+
+  bool writeAll(const uint8_t* data, size_t size) {
+#ifdef _WIN32
+    return fwrite(data, 1, size, file) == size;
+#else
+    while (size > 0) {
+      ssize_t n = ::write(fd, data, size);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      data += n;
+      size -= (size_t)n;
+    }
+    return true;
+#endif
+  }
+
+  /*
+   * O_DIRECT only takes page multiples, the tail of the last buffer goes through the
+   * page cache.
+   */
+  bool writeBuffer(const Buffer& b) {
+    if (!directIo) {
+      return writeAll(b.data, b.size);
+    }
+    size_t aligned = b.size / ALIGNMENT * ALIGNMENT;
+    if (aligned > 0 && !writeAll(b.data, aligned)) {
+      return false;
+    }
+    if (aligned < b.size) {
+      // only the last buffer has a tail.
+#ifdef O_DIRECT
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+      return writeAll(b.data + aligned, b.size - aligned);
+    }
+    return true;
+  }
+
+  void writerLoop() {
+    while (true) {
+      Buffer b;
+      {
+        std::unique_lock<std::mutex> lk{mtx};
+        cv.wait(lk, [this] { return stopping || !fullBuffers.empty(); });
+        if (fullBuffers.empty()) {
+          break;
+        }
+        b = fullBuffers.front();
+        fullBuffers.pop_front();
+      }
+
+      bool ok = writeBuffer(b);
+
+      {
+        std::lock_guard<std::mutex> lg{mtx};
+        if (!ok) {
+          failed = true;
+        }
+        bytesWritten += b.size;
+        b.size = 0;
+        freeBuffers.push_back(b);
+      }
+      cv.notify_all();
+    }
+  }
+
+  void submitCurrent() {
+    std::unique_lock<std::mutex> lk{mtx};
+    // back pressure, wait for the disk when every buffer is queued.
+    cv.wait(lk, [this] { return !freeBuffers.empty(); });
+    Buffer next = freeBuffers.front();
+    freeBuffers.pop_front();
+    if (directIo) {
+      // keep O_DIRECT writes in page multiples, the tail moves on to the next buffer.
+      size_t tail = current.size % ALIGNMENT;
+      std::memcpy(next.data, current.data + current.size - tail, tail);
+      next.size = tail;
+      current.size -= tail;
+    }
+    fullBuffers.push_back(current);
+    current = next;
+    cv.notify_all();
+  }
+
+  void append(const uint8_t* src, size_t size) {
+    std::memcpy(current.data + current.size, src, size);
+    current.size += size;
+  }
+
+  void appendPlane(const uint8_t* src, int linesize, int w, int h) {
+    if (linesize == w) {
+      append(src, (size_t)w * h);
+    } else {
+      for (int i = 0; i < h; i++) {
+        append(src + (int64_t)i * linesize, w);
+      }
+    }
+  }
+
+ public:
+  YuvFrameWriter(const YuvFrameWriter&) = delete;
+  YuvFrameWriter& operator=(const YuvFrameWriter&) = delete;
+
+  YuvFrameWriter(const string& outputPath, int w, int h, AVRational frameRate,
+                 YuvWriterOptions opt = YuvWriterOptions())
+      : path(outputPath), width(w), height(h), options(opt) {
+    size_t frameSize = frameBytes();
+    // at least two frames per buffer, in page multiples.
+    capacity = std::max(options.bufferBytes, frameSize * 2);
+    capacity = (capacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+#ifdef _WIN32
+    file = fopen(path.c_str(), "wb");
+    bool opened = file != nullptr;
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (options.directIo) {
+      fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+      directIo = fd >= 0;
+    }
+#endif
+    if (options.directIo && !directIo) {
+      cout << "WARN: O_DIRECT is not supported for " << path << ", use buffered io." << endl;
+    }
+    if (fd < 0) {
+      fd = ::open(path.c_str(), flags, 0644);
+    }
+    bool opened = fd >= 0;
+#endif
+    if (!opened) {
+      string errorMsg = "Can not open output file:";
+      errorMsg += path;
+      cout << errorMsg << endl;
+      throw std::runtime_error(errorMsg);
+    }
+
+    for (int i = 0; i < std::max(options.bufferCount, 2); i++) {
+      uint8_t* p = alignedAlloc(capacity);
+      if (p == nullptr) {
+        throw std::runtime_error("YuvFrameWriter: alloc buffer failed.");
+      }
+      allBuffers.push_back(p);
+      Buffer b;
+      b.data = p;
+      freeBuffers.push_back(b);
+    }
+    current = freeBuffers.front();
+    freeBuffers.pop_front();
+
+    if (options.y4m) {
+      std::stringstream ss{};
+      ss << "YUV4MPEG2 W" << width << " H" << height << " F" << frameRate.num << ":"
+         << (frameRate.den > 0 ? frameRate.den : 1) << " Ip A1:1 C420jpeg\n";
+      string header = ss.str();
+      append((const uint8_t*)header.data(), header.size());
+    }
+
+    writerThread = std::thread{&YuvFrameWriter::writerLoop, this};
+  }
+
+  ~YuvFrameWriter() { close(); }
+
+  size_t frameBytes() const {
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    size_t frameSize = (size_t)width * height + chroma * 2;
+    return options.y4m ? frameSize + 6 : frameSize;
+  }
+
+  /*
+   * the frame must be yuv420p of the writer's size.
+   */
+  void writeFrame(const AVFrame* frame) {
+    if (current.size + frameBytes() > capacity) {
+      submitCurrent();
+    }
+    if (options.y4m) {
+      append((const uint8_t*)"FRAME\n", 6);
+    }
+    appendPlane(frame->data[0], frame->linesize[0], width, height);
+    // odd sizes round the chroma planes up, like yuv420p itself.
+    appendPlane(frame->data[1], frame->linesize[1], (width + 1) / 2, (height + 1) / 2);
+    appendPlane(frame->data[2], frame->linesize[2], (width + 1) / 2, (height + 1) / 2);
+    framesWritten++;
+  }
+
+  /*
+   * flush the pending data and wait for the writer thread.
+   *  return
+   *          true   : everything is on disk(or in page cache)
+   *          false  : some write failed
+   */
+  bool close() {
+    if (!writerThread.joinable()) {
+      return !failed;
+    }
+    {
+      std::lock_guard<std::mutex> lg{mtx};
+      if (current.size > 0) {
+        fullBuffers.push_back(current);
+      }
+      current = Buffer{};
+      stopping = true;
+    }
+    cv.notify_all();
+    writerThread.join();
+
+#ifdef _WIN32
+    fclose(file);
+    file = nullptr;
+#else
+    ::close(fd);
+    fd = -1;
+#endif
+    for (auto p : allBuffers) {
+      alignedFree(p);
+    }
+    allBuffers.clear();
+    freeBuffers.clear();
+
+    cout << "YuvFrameWriter closed: " << path << ", frames=" << framesWritten
+         << ", bytes=" << bytesWritten << (failed ? ", WRITE FAILED" : "") << endl;
+    return !failed;
+  }
+
+  int64_t getFramesWritten() const { return framesWritten; }
+};
+
+}  // namespace ffmpegUtil
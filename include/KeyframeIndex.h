@@ -0,0 +1,244 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ffmpegUtil {
+
+/*
+ * Sidecar file layout(little endian, no padding):
+ *
+ *   KeyframeIndexHeader
+ *   KeyframeEntry * header.count     (sorted by pts)
+ *
+ * The file is used directly from a read-only mapping.
+ */
+struct KeyframeIndexHeader {
+  char magic[4];  // "LPKI"
+  uint32_t version;
+  int32_t streamIndex;
+  int32_t timeBaseNum;
+  int32_t timeBaseDen;
+  uint32_t reserved;
+  int64_t inputSize;  // size of the indexed file, to detect stale sidecars.
+  uint64_t count;
+};
+
+struct KeyframeEntry {
+  int64_t pts;  // in stream time base
+  int64_t pos;  // byte offset of the keyframe packet, -1 if unknown
+  int32_t size;
+  int32_t flags;
+};
+
+static_assert(sizeof(KeyframeIndexHeader) == 40, "KeyframeIndexHeader layout changed.");
+static_assert(sizeof(KeyframeEntry) == 24, "KeyframeEntry layout changed.");
+
+class KeyframeIndex {
+  static const uint32_t VERSION = 1;
+
+  int streamIndex = -1;
+  AVRational timeBase{1, 1};
+  int64_t inputSize = -1;
+
+  std::vector<KeyframeEntry> ownedEntries{};
+  MappedFile mapped{};
+  const KeyframeEntry* entries = nullptr;
+  size_t count = 0;
+
+  static int64_t getInputSize(AVFormatContext* formatCtx) {
+    return formatCtx->pb != nullptr ? (int64_t)avio_size(formatCtx->pb) : -1;
+  }
+
+ public:
+  KeyframeIndex() = default;
+  KeyframeIndex(const KeyframeIndex&) = delete;
+  KeyframeIndex& operator=(const KeyframeIndex&) = delete;
+
+  static string sidecarPath(const string& inputPath) { return inputPath + ".kfi"; }
+
+  /*
+   * One demux-only pass over the whole input, nothing is decoded.
+   * The grabber is left at the end of the file.
+   */
+  static std::unique_ptr<KeyframeIndex> build(PacketGrabber& grabber, int targetStream = -1) {
+    if (targetStream < 0) {
+      targetStream =
+          grabber.getVideoIndex() >= 0 ? grabber.getVideoIndex() : grabber.getAudioIndex();
+    }
+    if (targetStream < 0) {
+      throw std::runtime_error("build keyframe index error: no audio or video stream.");
+    }
+
+    auto formatCtx = grabber.getFormatCtx();
+    // let the demuxer drop everything we do not index as early as possible.
+    for (unsigned int i = 0; i < formatCtx->nb_streams; i++) {
+      if ((int)i != targetStream) {
+        formatCtx->streams[i]->discard = AVDISCARD_ALL;
+      }
+    }
+
+    std::vector<KeyframeEntry> keyframes;
+    AVPacket* packet = av_packet_alloc();
+    int packetCount = 0;
+    while (grabber.grabPacket(packet) >= 0) {
+      if (packet->stream_index == targetStream) {
+        packetCount++;
+        if (packet->flags & AV_PKT_FLAG_KEY) {
+          KeyframeEntry e{};
+          e.pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+          e.pos = packet->pos;
+          e.size = packet->size;
+          e.flags = packet->flags;
+          if (e.pts != AV_NOPTS_VALUE) {
+            keyframes.push_back(e);
+          }
+        }
+      }
+      av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+
+    for (unsigned int i = 0; i < formatCtx->nb_streams; i++) {
+      formatCtx->streams[i]->discard = AVDISCARD_DEFAULT;
+    }
+
+    auto index = fromEntries(targetStream, formatCtx->streams[targetStream]->time_base,
+                             getInputSize(formatCtx), std::move(keyframes));
+    cout << "keyframe index built: stream=" << targetStream << ", packets=" << packetCount
+         << ", keyframes=" << index->count << endl;
+    return index;
+  }
+
+  /*
+   * An index over entries found elsewhere, they need not be sorted.
+   */
+  static std::unique_ptr<KeyframeIndex> fromEntries(int streamIndex, AVRational timeBase,
+                                                    int64_t inputSize,
+                                                    std::vector<KeyframeEntry> keyframes) {
+    std::unique_ptr<KeyframeIndex> index{new KeyframeIndex()};
+    index->streamIndex = streamIndex;
+    index->timeBase = timeBase;
+    index->inputSize = inputSize;
+    // demux order is dts order, keyframes may come out of pts order for some streams.
+    auto& v = index->ownedEntries;
+    v = std::move(keyframes);
+    std::stable_sort(v.begin(), v.end(), [](const KeyframeEntry& a, const KeyframeEntry& b) {
+      return a.pts < b.pts;
+    });
+    index->entries = v.data();
+    index->count = v.size();
+    return index;
+  }
+
+  bool save(const string& path) const {
+    KeyframeIndexHeader header{};
+    std::memcpy(header.magic, "LPKI", 4);
+    header.version = VERSION;
+    header.streamIndex = streamIndex;
+    header.timeBaseNum = timeBase.num;
+    header.timeBaseDen = timeBase.den;
+    header.inputSize = inputSize;
+    header.count = count;
+
+    std::ofstream os{path, std::ios::binary | std::ios::trunc};
+    if (!os) {
+      cout << "WARN: can not write keyframe index: " << path << endl;
+      return false;
+    }
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char*>(entries), sizeof(KeyframeEntry) * count);
+    return os.good();
+  }
+
+  /*
+   * Map a sidecar file, return nullptr if it is missing, broken or stale.
+   */
+  static std::unique_ptr<KeyframeIndex> load(const string& path, AVFormatContext* formatCtx) {
+    std::unique_ptr<KeyframeIndex> index{new KeyframeIndex()};
+    if (!index->mapped.map(path)) {
+      return nullptr;
+    }
+    auto data = index->mapped.data();
+    auto size = index->mapped.size();
+    if (size < sizeof(KeyframeIndexHeader)) {
+      return nullptr;
+    }
+
+    KeyframeIndexHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "LPKI", 4) != 0 || header.version != VERSION ||
+        size != sizeof(header) + sizeof(KeyframeEntry) * header.count) {
+      cout << "WARN: invalid keyframe index: " << path << endl;
+      return nullptr;
+    }
+
+    if (formatCtx != nullptr) {
+      if (header.streamIndex < 0 || header.streamIndex >= (int)formatCtx->nb_streams ||
+          header.inputSize != getInputSize(formatCtx)) {
+        cout << "WARN: stale keyframe index: " << path << endl;
+        return nullptr;
+      }
+    }
+
+    index->streamIndex = header.streamIndex;
+    index->timeBase = AVRational{header.timeBaseNum, header.timeBaseDen};
+    index->inputSize = header.inputSize;
+    index->entries = reinterpret_cast<const KeyframeEntry*>(data + sizeof(header));
+    index->count = (size_t)header.count;
+    return index;
+  }
+
+  static std::unique_ptr<KeyframeIndex> loadFor(const PacketGrabber& grabber) {
+    return load(sidecarPath(grabber.getInputUrl()), grabber.getFormatCtx());
+  }
+
+  /*
+   * O(log n) lookup, return the last keyframe with pts <= target, or the first keyframe.
+   */
+  const KeyframeEntry* lookup(int64_t pts) const {
+    if (count == 0) {
+      return nullptr;
+    }
+    auto end = entries + count;
+    auto it = std::upper_bound(entries, end, pts, [](int64_t t, const KeyframeEntry& e) {
+      return t < e.pts;
+    });
+    return it == entries ? entries : it - 1;
+  }
+
+  const KeyframeEntry* lookupMs(int64_t timestampMs) const {
+    return lookup(av_rescale_q(timestampMs, AVRational{1, 1000}, timeBase));
+  }
+
+  /*
+   * seek the grabber to the keyframe at or before timestampMs.
+   * Use a direct byte seek when the container allows it.
+   */
+  bool seek(PacketGrabber& grabber, int64_t timestampMs) const {
+    auto e = lookupMs(timestampMs);
+    if (e == nullptr) {
+      return false;
+    }
+    if (e->pos >= 0 && grabber.seekToByte(e->pos)) {
+      return true;
+    }
+    return grabber.seekToTimestamp(streamIndex, e->pts);
+  }
+
+  int getStreamIndex() const { return streamIndex; }
+  AVRational getTimeBase() const { return timeBase; }
+  size_t size() const { return count; }
+  const KeyframeEntry& operator[](size_t i) const { return entries[i]; }
+};
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Contention of the pipeline locks, per name: how often a lock was taken, how often it
+ * was busy, how long the callers waited for it and how long it was held. Locks of the
+ * same name are counted together, e.g. the packet queues of all audio streams.
+ *
+ * Off by default, then an InstrumentedMutex costs one relaxed load more than a mutex.
+ */
+class LockStats {
+ public:
+  // wait histogram: bucket 0 is under 1us, bucket k under 2^k us, the last one the rest.
+  static const int BUCKETS = 16;
+
+  struct Site {
+    const std::string name;
+    std::atomic<int64_t> acquired{0};
+    std::atomic<int64_t> contended{0};
+    std::atomic<int64_t> waitNs{0};
+    std::atomic<int64_t> maxWaitNs{0};
+    std::atomic<int64_t> holdNs{0};
+    std::atomic<int64_t> maxHoldNs{0};
+    std::atomic<int64_t> waits[BUCKETS];
+
+    explicit Site(const std::string& n) : name(n) {
+      for (auto& w : waits) {
+        w.store(0);
+      }
+    }
+
+    void addWait(int64_t ns) {
+      acquired++;
+      if (ns <= 0) {
+        waits[0]++;
+        return;
+      }
+      contended++;
+      waitNs += ns;
+      raise(maxWaitNs, ns);
+      int bucket = 0;
+      for (int64_t us = ns / 1000; us > 0 && bucket < BUCKETS - 1; us >>= 1) {
+        bucket++;
+      }
+      waits[bucket]++;
+    }
+
+    void addHold(int64_t ns) {
+      holdNs += ns;
+      raise(maxHoldNs, ns);
+    }
+
+   private:
+    static void raise(std::atomic<int64_t>& max, int64_t v) {
+      int64_t m = max.load();
+      while (v > m && !max.compare_exchange_weak(m, v)) {
+      }
+    }
+  };
+
+  // a copy of the counters of one site.
+  struct Reading {
+    std::string name;
+    int64_t acquired = 0;
+    int64_t contended = 0;
+    int64_t waitNs = 0;
+    int64_t maxWaitNs = 0;
+    int64_t holdNs = 0;
+    int64_t maxHoldNs = 0;
+    int64_t waits[BUCKETS] = {};
+  };
+
+ private:
+  std::mutex mtx{};
+  // sites are never removed, the locks keep pointers to them.
+  std::vector<std::unique_ptr<Site>> sites{};
+  std::atomic<bool> enabled{false};
+
+ public:
+  LockStats() = default;
+  LockStats(const LockStats&) = delete;
+  LockStats& operator=(const LockStats&) = delete;
+
+  static LockStats& shared() {
+    static LockStats stats{};
+    return stats;
+  }
+
+  static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  void setEnabled(bool e) { enabled.store(e); }
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+  Site& site(const std::string& name) {
+    std::lock_guard<std::mutex> lk{mtx};
+    for (auto& s : sites) {
+      if (s->name == name) {
+        return *s;
+      }
+    }
+    sites.emplace_back(new Site(name));
+    return *sites.back();
+  }
+
+  // the sites that were taken at least once, most waited for first.
+  std::vector<Reading> read() {
+    std::vector<Reading> readings{};
+    std::lock_guard<std::mutex> lk{mtx};
+    for (auto& s : sites) {
+      if (s->acquired.load() == 0) {
+        continue;
+      }
+      Reading r{};
+      r.name = s->name;
+      r.acquired = s->acquired.load();
+      r.contended = s->contended.load();
+      r.waitNs = s->waitNs.load();
+      r.maxWaitNs = s->maxWaitNs.load();
+      r.holdNs = s->holdNs.load();
+      r.maxHoldNs = s->maxHoldNs.load();
+      for (int b = 0; b < BUCKETS; b++) {
+        r.waits[b] = s->waits[b].load();
+      }
+      readings.push_back(r);
+    }
+    std::sort(readings.begin(), readings.end(),
+              [](const Reading& x, const Reading& y) { return x.waitNs > y.waitNs; });
+    return readings;
+  }
+
+  void printUsage() {
+    if (!isEnabled()) {
+      return;
+    }
+    for (auto& r : read()) {
+      std::cout << "lock " << r.name << ": taken=" << r.acquired << ", contended="
+                << r.contended << ", wait avg=" << r.waitNs / 1000.0 / r.acquired
+                << "us max=" << r.maxWaitNs / 1000.0 << "us, hold avg="
+                << r.holdNs / 1000.0 / r.acquired << "us max=" << r.maxHoldNs / 1000.0
+                << "us, waits:";
+      for (int b = 0; b < BUCKETS; b++) {
+        if (r.waits[b] > 0) {
+          std::cout << (b < BUCKETS - 1 ? " <" : " >=") << (1 << std::min(b, BUCKETS - 2))
+                    << "us=" << r.waits[b];
+        }
+      }
+      std::cout << std::endl;
+    }
+  }
+};
+
+/*
+ * std::mutex that reports to LockStats under its name, a drop in for lock_guard and
+ * unique_lock.
+ */
+class InstrumentedMutex {
+  std::mutex mtx{};
+  std::atomic<LockStats::Site*> site;
+  // only touched by the holder, 0 when the lock was taken without stats.
+  int64_t lockedAtNs = 0;
+
+ public:
+  explicit InstrumentedMutex(const std::string& name)
+      : site(&LockStats::shared().site(name)) {}
+
+  InstrumentedMutex(const InstrumentedMutex&) = delete;
+  InstrumentedMutex& operator=(const InstrumentedMutex&) = delete;
+
+  // e.g. once the owner knows what it is, before the lock is used.
+  void setName(const std::string& name) { site.store(&LockStats::shared().site(name)); }
+
+  void lock() {
+    if (!LockStats::shared().isEnabled()) {
+      mtx.lock();
+      lockedAtNs = 0;
+      return;
+    }
+    int64_t waited = 0;
+    if (!mtx.try_lock()) {
+      int64_t start = LockStats::nowNs();
+      mtx.lock();
+      waited = std::max((int64_t)1, LockStats::nowNs() - start);
+    }
+    lockedAtNs = LockStats::nowNs();
+    site.load()->addWait(waited);
+  }
+
+  bool try_lock() {
+    if (!mtx.try_lock()) {
+      return false;
+    }
+    lockedAtNs = 0;
+    if (LockStats::shared().isEnabled()) {
+      lockedAtNs = LockStats::nowNs();
+      site.load()->addWait(0);
+    }
+    return true;
+  }
+
+  void unlock() {
+    if (lockedAtNs != 0) {
+      site.load()->addHold(LockStats::nowNs() - lockedAtNs);
+    }
+    mtx.unlock();
+  }
+};
+
+/*
+ * condition variable on an InstrumentedMutex, the time spent waiting is counted as the
+ * wait of its own name.
+ */
+class InstrumentedCondition {
+  std::condition_variable_any cv{};
+  LockStats::Site& site;
+
+  void record(int64_t start) {
+    if (start != 0) {
+      site.addWait(std::max((int64_t)1, LockStats::nowNs() - start));
+    }
+  }
+
+  static int64_t startNs() {
+    return LockStats::shared().isEnabled() ? LockStats::nowNs() : 0;
+  }
+
+ public:
+  explicit InstrumentedCondition(const std::string& name)
+      : site(LockStats::shared().site(name)) {}
+
+  void notify_one() { cv.notify_one(); }
+  void notify_all() { cv.notify_all(); }
+
+  template <class Lock, class Predicate>
+  void wait(Lock& lk, Predicate pred) {
+    int64_t start = startNs();
+    cv.wait(lk, pred);
+    record(start);
+  }
+
+  template <class Lock, class Rep, class Period, class Predicate>
+  bool wait_for(Lock& lk, const std::chrono::duration<Rep, Period>& timeout,
+                Predicate pred) {
+    int64_t start = startNs();
+    bool got = cv.wait_for(lk, timeout, pred);
+    record(start);
+    return got;
+  }
+};
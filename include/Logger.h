@@ -0,0 +1,244 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include "ThreadPolicy.h"
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+enum LogLevel { LOG_DEBUG = 0, LOG_INFO = 1, LOG_WARN = 2, LOG_ERROR = 3 };
+
+// calls below this level are removed by the preprocessor, see ENABLE_DEBUG_LOG in cmake.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+#endif
+
+/*
+ * Rate limit of one call site: up to BURST lines per window, the rest are counted and
+ * reported with the first line of a later window.
+ */
+class LogRate {
+ public:
+  static const int BURST = 5;
+  static const int64_t WINDOW_MS = 1000;
+
+ private:
+  std::atomic<int64_t> windowStart{INT64_MIN / 2};
+  std::atomic<int> count{0};
+  std::atomic<int> suppressed{0};
+
+ public:
+  /*
+   *  return
+   *          true   : the line may be written, skipped is set to the lines suppressed
+   *                   since the last one written.
+   */
+  bool admit(int64_t nowMs, int& skipped) {
+    skipped = 0;
+    int64_t start = windowStart.load(std::memory_order_relaxed);
+    if (nowMs - start >= WINDOW_MS && windowStart.compare_exchange_strong(start, nowMs)) {
+      count.store(0, std::memory_order_relaxed);
+    }
+    if (count.fetch_add(1, std::memory_order_relaxed) < BURST) {
+      skipped = suppressed.exchange(0, std::memory_order_relaxed);
+      return true;
+    }
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+};
+
+/*
+ * Leveled logger that never blocks its callers: a line is formatted into a slot of a
+ * fixed ring(bounded MPMC queue, a sequence number per slot) and written to stdout by
+ * the writer thread. Neither side takes a lock, nothing is allocated per line. A full
+ * ring drops the line and counts it, the decoders and the audio callback go on.
+ */
+class Logger {
+ public:
+  static const int CAPACITY = 1024;  // power of 2
+  static const int LINE_BYTES = 240;
+  // the writer sleeps this long when the ring is empty.
+  static const int IDLE_MS = 20;
+
+ private:
+  struct Slot {
+    std::atomic<size_t> seq{0};
+    int level = LOG_INFO;
+    char text[LINE_BYTES];
+  };
+
+  Slot slots[CAPACITY];
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+  std::atomic<int> level{LOG_MIN_LEVEL};
+  std::atomic<int64_t> dropped{0};
+  std::atomic<bool> running{true};
+  std::thread writer{};
+
+  static const char* levelName(int l) {
+    switch (l) {
+      case LOG_DEBUG:
+        return "DEBUG: ";
+      case LOG_INFO:
+        return "";
+      case LOG_WARN:
+        return "WARN: ";
+      default:
+        return "ERROR: ";
+    }
+  }
+
+  static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  Slot* claim() {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots[pos & (CAPACITY - 1)];
+      size_t seq = slot.seq.load(std::memory_order_acquire);
+      if (seq == pos) {
+        if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          return &slot;
+        }
+      } else if (seq < pos) {
+        // the writer has not caught up.
+        return nullptr;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // only the writer thread pops.
+  bool writeOne() {
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot& slot = slots[pos & (CAPACITY - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != pos + 1) {
+      return false;
+    }
+    std::cout << levelName(slot.level) << slot.text << '\n';
+    slot.seq.store(pos + CAPACITY, std::memory_order_release);
+    head.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void drain() {
+    bool wrote = false;
+    while (writeOne()) {
+      wrote = true;
+    }
+    int64_t lost = dropped.exchange(0);
+    if (lost > 0) {
+      std::cout << "WARN: logger ring full, dropped " << lost << " lines." << '\n';
+      wrote = true;
+    }
+    if (wrote) {
+      std::cout.flush();
+    }
+  }
+
+  void writeLoop() {
+    ThreadPolicy::shared().apply("lp-log", ThreadRole::OTHER);
+    while (running.load()) {
+      drain();
+      std::this_thread::sleep_for(std::chrono::milliseconds((int)IDLE_MS));
+    }
+    drain();
+  }
+
+ public:
+  Logger() {
+    for (int i = 0; i < CAPACITY; i++) {
+      slots[i].seq.store((size_t)i, std::memory_order_relaxed);
+    }
+    writer = std::thread{&Logger::writeLoop, this};
+  }
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  ~Logger() {
+    running.store(false);
+    writer.join();
+  }
+
+  static Logger& shared() {
+    static Logger logger{};
+    return logger;
+  }
+
+  // at run time, only above what was compiled in.
+  void setLevel(int l) { level.store(l); }
+  bool isEnabled(int l) const { return l >= level.load(std::memory_order_relaxed); }
+
+  static int parseLevel(const std::string& name) {
+    if (name == "debug") return LOG_DEBUG;
+    if (name == "warn") return LOG_WARN;
+    if (name == "error") return LOG_ERROR;
+    return LOG_INFO;
+  }
+
+  void log(int l, LogRate& rate, const char* format, ...) {
+    if (!isEnabled(l)) {
+      return;
+    }
+    int skipped = 0;
+    if (!rate.admit(nowMs(), skipped)) {
+      return;
+    }
+    Slot* slot = claim();
+    if (slot == nullptr) {
+      dropped++;
+      return;
+    }
+    slot->level = l;
+    va_list args;
+    va_start(args, format);
+    int n = std::vsnprintf(slot->text, LINE_BYTES, format, args);
+    va_end(args);
+    if (skipped > 0 && n >= 0 && n < LINE_BYTES) {
+      std::snprintf(slot->text + n, LINE_BYTES - n, " (%d more suppressed)", skipped);
+    }
+    size_t pos = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(pos + 1, std::memory_order_release);
+  }
+
+  int64_t getDropped() const { return dropped.load(); }
+};
+
+// printf style, every call site has its own LogRate.
+// LogRate is constant initialized, there is no guard to take on the first call.
+#define LOG_AT(l, ...)                              \
+  do {                                              \
+    static LogRate logRate_{};                      \
+    Logger::shared().log(l, logRate_, __VA_ARGS__); \
+  } while (0)
+
+#if LOG_MIN_LEVEL <= 0
+#define LOGD(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+#else
+#define LOGD(...) \
+  do {            \
+  } while (0)
+#endif
+
+#if LOG_MIN_LEVEL <= 1
+#define LOGI(...) LOG_AT(LOG_INFO, __VA_ARGS__)
+#else
+#define LOGI(...) \
+  do {            \
+  } while (0)
+#endif
+
+#define LOGW(...) LOG_AT(LOG_WARN, __VA_ARGS__)
+#define LOGE(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
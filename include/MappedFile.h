@@ -0,0 +1,118 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <string>
+
+namespace ffmpegUtil {
+
+/*
+ * Read-only memory mapping of a whole file.
+ * Sidecar files (keyframe index, peak files) are laid out so that they can be used
+ * directly from the mapping, without any parsing or copying.
+ */
+class MappedFile {
+  const uint8_t* mappedData = nullptr;
+  size_t mappedSize = 0;
+
+#ifdef _WIN32
+  HANDLE fileHandle = INVALID_HANDLE_VALUE;
+  HANDLE mappingHandle = nullptr;
+#endif
+
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile() { unmap(); }
+
+  /*
+   *  return
+   *          true   : file mapped, data() and size() are valid
+   *          false  : file can not be opened or is empty
+   */
+  bool map(const std::string& path) {
+    unmap();
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+      unmap();
+      return false;
+    }
+    mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mappingHandle == nullptr) {
+      unmap();
+      return false;
+    }
+    mappedData = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (mappedData == nullptr) {
+      unmap();
+      return false;
+    }
+    mappedSize = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps its own reference to the file.
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    mappedData = (const uint8_t*)p;
+    mappedSize = (size_t)st.st_size;
+#endif
+    return true;
+  }
+
+  void unmap() {
+#ifdef _WIN32
+    if (mappedData != nullptr) {
+      UnmapViewOfFile(mappedData);
+    }
+    if (mappingHandle != nullptr) {
+      CloseHandle(mappingHandle);
+      mappingHandle = nullptr;
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+      CloseHandle(fileHandle);
+      fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mappedData != nullptr) {
+      munmap((void*)mappedData, mappedSize);
+    }
+#endif
+    mappedData = nullptr;
+    mappedSize = 0;
+  }
+
+  const uint8_t* data() const { return mappedData; }
+  size_t size() const { return mappedSize; }
+  bool isMapped() const { return mappedData != nullptr; }
+};
+
+}  // namespace ffmpegUtil
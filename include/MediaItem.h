@@ -0,0 +1,301 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+#include "MediaProcessor.hpp"
+#include "PacketPool.h"
+#include "KeyframeIndex.h"
+#include "SegmentedPacketGrabber.h"
+#include "PlayOptions.h"
+#include "StopSignal.h"
+#include "ThreadPolicy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace ffmpegUtil {
+
+/*
+ * a packet read for a stream whose budget could not take it yet. It is delivered before
+ * anything else is read, so the other streams wait too and the file order is kept.
+ */
+struct HeldPacket {
+  AVPacket* packet = nullptr;
+  int streamIndex = -1;
+
+  HeldPacket() = default;
+  HeldPacket(const HeldPacket&) = delete;
+  HeldPacket& operator=(const HeldPacket&) = delete;
+  ~HeldPacket() { PacketPool::shared().release(packet); }
+};
+
+/*
+ * read packets as long as a decoder needs more, or up to the file end.
+ * Either processor may be null, when the stream is absent or not selected.
+ * A packet the budget refuses is held and reading stops until its stream drained.
+ */
+inline void readPackets(PacketSource& pGrabber, AudioProcessor* aProcessor,
+                        VideoProcessor* vProcessor, HeldPacket& held, StopSignal& stop) {
+  int audioIndex = aProcessor != nullptr ? aProcessor->getAudioIndex() : -1;
+  int videoIndex = vProcessor != nullptr ? vProcessor->getVideoIndex() : -1;
+  auto deliver = [&](AVPacket* packet, int index) {
+    MediaProcessor* target = index == audioIndex ? (MediaProcessor*)aProcessor : vProcessor;
+    if (!target->canTake(packet)) {
+      held.packet = packet;
+      held.streamIndex = index;
+      return false;
+    }
+    target->pushPkt(unique_ptr<AVPacket>(packet));
+    return true;
+  };
+  if (held.packet != nullptr) {
+    AVPacket* packet = held.packet;
+    held.packet = nullptr;
+    if (!deliver(packet, held.streamIndex)) {
+      return;
+    }
+  }
+  while (((aProcessor != nullptr && aProcessor->needPacket()) ||
+          (vProcessor != nullptr && vProcessor->needPacket())) &&
+         !stop.isStopped()) {
+    AVPacket* packet = PacketPool::shared().acquire();
+    if (packet == nullptr) {
+      throw std::runtime_error("read packet error: out of memory.");
+    }
+    int t = pGrabber.grabPacket(packet);
+    if (t == -1) {
+      LOGI("file finish.");
+      PacketPool::shared().release(packet);
+      if (aProcessor != nullptr) aProcessor->pushPkt(nullptr);
+      if (vProcessor != nullptr) vProcessor->pushPkt(nullptr);
+      break;
+    } else if ((t == audioIndex && aProcessor != nullptr) ||
+               (t == videoIndex && vProcessor != nullptr)) {
+      if (!deliver(packet, t)) {
+        break;
+      }
+    } else {
+      // a stream that is not played.
+      PacketPool::shared().release(packet);
+    }
+  }
+}
+
+/*
+ * Reads until the file end or a finished decoder, and posts the refills the audio callback
+ * asks for until the audio decoder finished too. Runs until then, or stop.
+ */
+inline void pktReader(PacketSource& pGrabber, AudioProcessor* aProcessor,
+                      VideoProcessor* vProcessor, int checkPeriod, StopSignal& stop) {
+  ThreadPolicy::shared().apply("lp-reader", ThreadRole::READER);
+  cout << "INFO: pkt Reader thread started." << endl;
+  HeldPacket held{};
+  while (true) {
+    bool reading = !pGrabber.isFileEnd() &&
+                   (aProcessor == nullptr || !aProcessor->isClosed()) &&
+                   (vProcessor == nullptr || !vProcessor->isClosed());
+    bool refilling = aProcessor != nullptr && !aProcessor->isClosed();
+    if (!reading && !refilling) {
+      break;
+    }
+    int period = checkPeriod;
+    if (refilling) {
+      aProcessor->serviceRefill();
+      period = std::min(period, aProcessor->refillPeriodMs());
+    }
+    if (reading) {
+      readPackets(pGrabber, aProcessor, vProcessor, held, stop);
+    }
+    if (stop.waitFor(period)) {
+      break;
+    }
+  }
+  cout << "[THREAD] INFO: pkt Reader thread finished." << endl;
+}
+
+// from this speed on, frames no other frame refers to are not decoded at all.
+const double SKIP_NONREF_SPEED = 2.0;
+
+/*
+ * speed of everything in the item, the audio is stretched and
+ * the video decoder skips what it can.
+ */
+inline void applySpeed(VideoProcessor* video, AudioProcessor* audio, double speed) {
+  if (audio != nullptr) {
+    audio->setTempo(speed);
+  }
+  if (video != nullptr) {
+    video->setSkipNonRef(speed >= SKIP_NONREF_SPEED);
+  }
+}
+
+/*
+ * Everything needed to play one file, without the outputs. Opening it also starts the
+ * decoders and the packet reader, so an item opened ahead of time is already primed when
+ * it is played. Items share the executor, the memory budget and the packet pool, any
+ * number can play at once; each has its own input, reader thread and decoders.
+ * Cooperative items have no reader thread, the owner loop calls readStep.
+ */
+struct MediaItem {
+  const string inputFile;
+  unique_ptr<PacketSource> packetSource;
+  unique_ptr<VideoProcessor> videoProcessor;
+  unique_ptr<AudioProcessor> audioProcessor;
+  StopSignal readerStop{};
+  std::thread readerThread;
+  HeldPacket heldPacket{};
+
+  MediaItem(const string& file) : inputFile(file) {}
+
+  MediaItem(const MediaItem&) = delete;
+  MediaItem& operator=(const MediaItem&) = delete;
+
+  /*
+   * park the reader and the decoders, or wake them up again. Nothing is torn down.
+   */
+  void setPaused(bool paused) {
+    readerStop.setPaused(paused);
+    if (videoProcessor != nullptr) {
+      videoProcessor->setPaused(paused);
+    }
+    if (audioProcessor != nullptr) {
+      audioProcessor->setPaused(paused);
+    }
+  }
+
+  // the part of the reader thread for one round, cooperative items only.
+  void readStep() {
+    if (readerThread.joinable()) {
+      return;
+    }
+    if (audioProcessor != nullptr) {
+      audioProcessor->serviceRefill();
+    }
+    if (!packetSource->isFileEnd()) {
+      readPackets(*packetSource, audioProcessor.get(), videoProcessor.get(), heldPacket,
+                  readerStop);
+    }
+  }
+
+  /*
+   * the reader first, it feeds the decoders, then the decoders.
+   * Every thread is woken up and joined, nothing is left running on a dead item.
+   */
+  ~MediaItem() {
+    auto t0 = std::chrono::steady_clock::now();
+    readerStop.stop();
+    if (readerThread.joinable()) {
+      readerThread.join();
+    }
+    if (audioProcessor != nullptr) {
+      audioProcessor->close();
+    }
+    if (videoProcessor != nullptr) {
+      videoProcessor->close();
+    }
+    std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t0;
+    cout << "MediaItem closed: " << inputFile << ", cost=" << (diff.count() * 1000) << "ms"
+         << endl;
+  }
+};
+
+inline void seekToStart(PacketGrabber& packetGrabber, int64_t startMs) {
+  auto index = KeyframeIndex::loadFor(packetGrabber);
+  bool sought;
+  if (index != nullptr) {
+    cout << "keyframe index loaded, keyframes=" << index->size() << endl;
+    sought = index->seek(packetGrabber, startMs);
+  } else {
+    sought = packetGrabber.seekToTimestamp(-1, startMs * (AV_TIME_BASE / 1000));
+  }
+  cout << "seek to start [" << startMs << "]ms: " << sought << endl;
+}
+
+// audio only: queue 4s of decoded audio, refill below 1s.
+const int AUDIO_ONLY_READ_AHEAD_MS = 4000;
+const int AUDIO_ONLY_REFILL_MS = 1000;
+// enough packets for the whole refill, read in a few wakeups.
+const int AUDIO_ONLY_PACKET_QUEUE = 256;
+const int AUDIO_ONLY_READER_PERIOD_MS = 100;
+
+inline unique_ptr<MediaItem> openMediaItem(const string& inputFile,
+                                           const PlayOptions& options) {
+  unique_ptr<MediaItem> item{new MediaItem(inputFile)};
+
+  // create packet grabber
+  if (SegmentedPacketGrabber::isManifest(inputFile)) {
+    if (options.startMs > 0) {
+      cout << "WARN: start position is ignored for segmented input." << endl;
+    }
+    item->packetSource.reset(new SegmentedPacketGrabber{inputFile, options.segmentPrefetch});
+  } else {
+    auto packetGrabber = new PacketGrabber{inputFile};
+    item->packetSource.reset(packetGrabber);
+    if (options.startMs > 0) {
+      seekToStart(*packetGrabber, options.startMs);
+    }
+  }
+  auto formatCtx = item->packetSource->getFormatCtx();
+  av_dump_format(formatCtx, 0, "", 0);
+
+  // cover art of music files comes as a video stream of a single picture.
+  int videoIndex = item->packetSource->getVideoIndex();
+  bool hasVideo = !options.noVideo && videoIndex >= 0 &&
+                  !(formatCtx->streams[videoIndex]->disposition & AV_DISPOSITION_ATTACHED_PIC);
+  bool hasAudio = item->packetSource->getAudioIndex() >= 0 && !(options.noAudio && hasVideo);
+  if (!hasVideo && !hasAudio) {
+    string errMsg = "nothing to play in: ";
+    errMsg += inputFile;
+    cout << errMsg << endl;
+    throw std::runtime_error(errMsg);
+  }
+
+  if (hasVideo) {
+    item->videoProcessor.reset(new VideoProcessor(formatCtx));
+    item->videoProcessor->setMemoryName(inputFile + " video");
+  }
+
+  if (hasAudio) {
+    item->audioProcessor.reset(new AudioProcessor(formatCtx));
+    item->audioProcessor->setMemoryName(inputFile + " audio");
+    item->audioProcessor->setVolume(options.volume);
+    item->audioProcessor->setMute(options.mute);
+    item->audioProcessor->setDownmix(options.downmixFor(inputFile));
+    if (!hasVideo) {
+      // nothing to keep in sync, decode far ahead and let the threads sleep.
+      item->audioProcessor->setReadAhead(AUDIO_ONLY_READ_AHEAD_MS, AUDIO_ONLY_REFILL_MS);
+      item->audioProcessor->setPacketQueueSize(AUDIO_ONLY_PACKET_QUEUE);
+    }
+  }
+
+  // the buffers of this item are charged now, refuse it instead of running out of memory.
+  if (MemoryBudget::shared().isExhausted()) {
+    MemoryBudget::shared().printUsage();
+    string errMsg = "memory budget exhausted, can not open: ";
+    errMsg += inputFile;
+    cout << errMsg << endl;
+    throw std::runtime_error(errMsg);
+  }
+  if (item->videoProcessor != nullptr) {
+    item->videoProcessor->start();
+  }
+  if (item->audioProcessor != nullptr) {
+    item->audioProcessor->start();
+  }
+  applySpeed(item->videoProcessor.get(), item->audioProcessor.get(), options.speed);
+
+  if (options.cooperative) {
+    return item;
+  }
+  // start pkt reader
+  int checkPeriod = hasVideo ? 10 : AUDIO_ONLY_READER_PERIOD_MS;
+  item->readerThread =
+      std::thread{pktReader, std::ref(*item->packetSource), item->audioProcessor.get(),
+                  item->videoProcessor.get(), checkPeriod, std::ref(item->readerStop)};
+  return item;
+}
+
+}  // namespace ffmpegUtil
@@ -3,7 +3,18 @@
 @since 2020/3/1
 @version 0.0.1-SNAPSHOT 2020/5/13
 */
+#pragma once
+
 #include "ffmpegUtil.h"
+#include "AudioGain.h"
+#include "AudioMeter.h"
+#include "AudioRing.h"
+#include "AudioTempo.h"
+#include "TaskExecutor.h"
+#include "MemoryBudget.h"
+#include "PacketPool.h"
+#include "Logger.h"
+#include "LockStats.h"
 
 #include <iostream>
 #include <string>
@@ -14,6 +25,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include <algorithm>
 
 using std::condition_variable;
 using std::cout;
@@ -26,33 +38,45 @@ using std::unique_ptr;
 
 class MediaProcessor {
   list<unique_ptr<AVPacket>> packetList{};
-  mutex pktListMutex{};
+  InstrumentedMutex pktListMutex{"stream.pktList"};
   int PKT_WAITING_SIZE = 3;
-  bool started = false;
-  bool closed = false;
-  bool streamFinished = false;
+  // size of the last queued packet, what the next one is expected to take.
+  int64_t lastPacketBytes = 0;
+  // started: decode steps may run, closed: the decoder has finished or was closed.
+  std::atomic<bool> started{false};
+  std::atomic<bool> closed{false};
+  std::atomic<bool> streamFinished{false};
+  // decode steps of this stream, in order, on the shared executor.
+  TaskStrand strand{TaskExecutor::shared()};
+  // a decode step is posted and has not started yet.
+  std::atomic<bool> stepQueued{false};
+  std::atomic<bool> paused{false};
 
   AVFrame* nextFrame = av_frame_alloc();
   AVPacket* targetPkt = nullptr;
+  bool frameReceived = false;
 
-  void nextFrameKeeper() {
-    auto lastPrepareTime = std::chrono::system_clock::now();
-    while (!streamFinished && started) {
-      std::unique_lock<std::mutex> lk{nextDataMutex};
-      cv.wait(lk, [this] { return !started || !isNextDataReady.load(); });
-      if (!started) {
-        break;
+  /*
+   * decode until the data is ready, the packets run out or the stream ends.
+   * Nothing waits in here, a new packet or a consumer posts the next step.
+   */
+  void decodeStep() {
+    stepQueued.store(false);
+    try {
+      std::lock_guard<InstrumentedMutex> lk{nextDataMutex};
+      if (!started.load() || isNextDataReady.load()) {
+        return;
       }
-      auto prepareTime = std::chrono::system_clock::now();
-      std::chrono::duration<double> diff = prepareTime - lastPrepareTime;
-      lastPrepareTime = prepareTime;
-      // cout << "+++++++++++  PrepareNextData, index="<< streamIndex <<", prepare
-      // intervalTime=" << (diff.count() * 1000) << "ms" <<endl;
       prepareNextData();
+    } catch (std::exception& e) {
+      LOGE("decoder failed, index=%d: %s", streamIndex, e.what());
+      streamFinished.store(true);
+    }
+    if (streamFinished.load()) {
+      LOGI("[TASK] decoder finished, index=%d", streamIndex);
+      started.store(false);
+      closed.store(true);
     }
-    cout << "[THREAD] next frame keeper finished, index=" << streamIndex << endl;
-    started = false;
-    closed = true;
   }
 
  protected:
@@ -64,18 +88,47 @@ class MediaProcessor {
   int streamIndex = -1;
   AVCodecContext* codecCtx = nullptr;
 
-  condition_variable cv{};
-  mutex nextDataMutex{};
+  InstrumentedMutex nextDataMutex{"stream.nextData"};
 
   std::atomic<bool> isNextDataReady{false};
 
+  // bytes of the queues of this stream, in the budget of the process.
+  MemoryBudget::Account memory{"stream"};
+
+  static int64_t packetBytes(const AVPacket* pkt) {
+    return pkt != nullptr ? (int64_t)sizeof(AVPacket) + pkt->size : 0;
+  }
+
   virtual void generateNextData(AVFrame* f) = 0;
 
+  /*
+   * whether the keeper can stop decoding, after generateNextData.
+   * One frame is enough by default, a queue keeps decoding up to its target.
+   */
+  virtual bool isDataFull() { return true; }
+
+  /*
+   * how long the consumer can go on without a new decode step, in ms.
+   * The deadline of the step on a cooperative executor.
+   */
+  virtual int64_t slackMs() { return 0; }
+
+  /*
+   * convert the last decoded frame again, after the output settings changed.
+   * nextDataMutex must be held by the caller.
+   */
+  void regenerateNextData() {
+    if (frameReceived) {
+      generateNextData(nextFrame);
+    }
+    isNextDataReady.store(isDataFull());
+  }
+
   unique_ptr<AVPacket> getNextPkt() {
     if (noMorePkt) {
       return nullptr;
     }
-    std::lock_guard<std::mutex> lg(pktListMutex);
+    std::lock_guard<InstrumentedMutex> lg{pktListMutex};
     if (packetList.empty()) {
       return nullptr;
     } else {
@@ -85,6 +138,7 @@ class MediaProcessor {
         return nullptr;
       } else {
         packetList.pop_front();
+        memory.release(MemoryBudget::PACKETS, packetBytes(pkt.get()));
         return pkt;
       }
     }
@@ -104,27 +158,24 @@ class MediaProcessor {
           }
         } else {
           // no more pkt.
-          cout << "++++++++ no more pkt index=" << streamIndex
-               << " finished=" << streamFinished << endl;
+          LOGD("no more pkt index=%d finished=%d", streamIndex, (int)streamFinished.load());
         }
       }
 
       int ret = -1;
       ret = avcodec_send_packet(codecCtx, targetPkt);
       if (ret == 0) {
-        av_packet_free(&targetPkt);
-        targetPkt = nullptr;
+        PacketPool::shared().release(targetPkt);
         // cout << "[AUDIO] avcodec_send_packet success." << endl;
       } else if (ret == AVERROR(EAGAIN)) {
         // buff full, can not decode any more, nothing need to do.
         // keep the packet for next time decode.
       } else if (ret == AVERROR_EOF) {
         // no new packets can be sent to it, it is safe.
-        cout << "[WARN]  no new packets can be sent to it. index=" << streamIndex << endl;
+        LOGW("no new packets can be sent to it. index=%d", streamIndex);
       } else {
-        string errorMsg = "+++++++++ ERROR avcodec_send_packet error: ";
-        errorMsg += ret;
-        cout << errorMsg << endl;
+        string errorMsg = "avcodec_send_packet error: ";
+        errorMsg += std::to_string(ret);
         throw std::runtime_error(errorMsg);
       }
 
@@ -132,33 +183,32 @@ class MediaProcessor {
       if (ret == 0) {
         // cout << "avcodec_receive_frame success." << endl;
         // success.
+        frameReceived = true;
         generateNextData(nextFrame);
-        isNextDataReady.store(true);
+        isNextDataReady.store(isDataFull());
       } else if (ret == AVERROR_EOF) {
-        cout << "+++++++++++++++++++++++++++++ MediaProcessor no more output frames. index="
-             << streamIndex << endl;
+        LOGI("MediaProcessor no more output frames. index=%d", streamIndex);
         streamFinished = true;
       } else if (ret == AVERROR(EAGAIN)) {
         // need more packet.
       } else {
         string errorMsg = "avcodec_receive_frame error: ";
-        errorMsg += ret;
-        cout << errorMsg << endl;
+        errorMsg += std::to_string(ret);
         throw std::runtime_error(errorMsg);
       }
     }
   }
 
  public:
-  ~MediaProcessor() { 
+  ~MediaProcessor() {
+    // normally closed by the subclass already, the keeper calls its generateNextData.
+    close();
 
     if (nextFrame != nullptr) {
       av_frame_free(&nextFrame);
     }
 
-    if (targetPkt != nullptr) {
-      av_packet_free(&targetPkt);
-    }
+    PacketPool::shared().release(targetPkt);
     
     if (codecCtx != nullptr) {
       avcodec_free_context(&codecCtx);
@@ -167,44 +217,120 @@ class MediaProcessor {
     //very important here.
     for (auto& p : packetList) {
       auto pkt = p.release();
-      av_packet_free(&pkt);
+      PacketPool::shared().release(pkt);
     }
 
     cout << "~MediaProcessor called. index=" << streamIndex << endl;
   }
   void start() {
-    started = true;
-    std::thread keeper{&MediaProcessor::nextFrameKeeper, this};
-    keeper.detach();
+    if (started.load()) {
+      return;
+    }
+    strand.open();
+    stepQueued.store(false);
+    closed.store(false);
+    started.store(true);
+    requestData();
   }
 
+  /*
+   * stop decoding, it can be started again afterwards.
+   * Queued steps are dropped, this returns as soon as the step being run, if any, is done.
+   */
   bool close() {
-    started = false;
-    int c = 5;
-    while (!closed && c > 0) {
-      c--;
-      cv.notify_one();
-      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    started.store(false);
+    strand.close();
+    closed.store(true);
+    return true;
+  }
+
+  /*
+   * post a decode step, unless one is waiting already or nothing is needed.
+   * Called by the consumers when they took data and by pushPkt.
+   */
+  void requestData() {
+    if (!started.load() || paused.load() || isNextDataReady.load() ||
+        stepQueued.exchange(true)) {
+      return;
+    }
+    auto& executor = TaskExecutor::shared();
+    int64_t deadline = executor.isCooperative() ? TaskExecutor::nowMs() + slackMs() : 0;
+    if (!strand.post([this] { decodeStep(); }, deadline)) {
+      stepQueued.store(false);
     }
-    return closed;
   }
 
-  bool isClosed() { return closed; }
+  bool isClosed() { return closed.load(); }
+
+  /*
+   * no decode steps are posted while paused, resume posts one if data is missing.
+   */
+  void setPaused(bool p) {
+    paused.store(p);
+    if (!p) {
+      requestData();
+    }
+  }
 
   void pushPkt(unique_ptr<AVPacket> pkt) {
-    std::lock_guard<std::mutex> lg(pktListMutex);
-    packetList.push_back(std::move(pkt));
+    {
+      std::lock_guard<InstrumentedMutex> lg{pktListMutex};
+      if (pkt != nullptr) {
+        lastPacketBytes = packetBytes(pkt.get());
+        memory.charge(MemoryBudget::PACKETS, lastPacketBytes);
+      }
+      packetList.push_back(std::move(pkt));
+    }
+    requestData();
+  }
+  bool isStreamFinished() { return streamFinished.load(); }
+
+  /*
+   * how many packets are kept waiting for the decoder.
+   */
+  void setPacketQueueSize(int size) {
+    std::lock_guard<InstrumentedMutex> lg{pktListMutex};
+    PKT_WAITING_SIZE = size;
   }
-  bool isStreamFinished() { return streamFinished; }
 
   bool needPacket() {
     bool need;
-    std::lock_guard<std::mutex> lg(pktListMutex);
-    need = packetList.size() < PKT_WAITING_SIZE;
+    std::lock_guard<InstrumentedMutex> lg{pktListMutex};
+    // the biggest streams wait while the budget is tight, they drain by decoding.
+    need = packetList.size() < PKT_WAITING_SIZE && memory.canGrow(lastPacketBytes);
     return need;
   }
 
+  /*
+   * whether the budget lets the queue take pkt. The queue length above is a reading target
+   * only, the other stream's packets may come first; the budget is a hard limit.
+   */
+  bool canTake(const AVPacket* pkt) { return memory.canGrow(packetBytes(pkt)); }
+
   uint64_t getPts() { return currentTimestamp.load(); }
+
+  // the locks of all streams of a kind are counted together, see LockStats.
+  void setLockNames(const string& kind) {
+    pktListMutex.setName(kind + ".pktList");
+    nextDataMutex.setName(kind + ".nextData");
+  }
+
+  // the name of this stream in the memory usage.
+  void setMemoryName(const string& name) { memory.setName(name); }
+};
+
+/*
+ * decode to device latency of the audio since the last call of getLatencyStats.
+ */
+struct AudioLatencyStats {
+  double avgMs = 0;
+  double maxMs = 0;
+  // the device buffer part of it.
+  double deviceMs = 0;
+  // data the decoder keeps ready, on top of the device buffer.
+  double queueMs = 0;
+  int64_t callbacks = 0;
+  int64_t underruns = 0;
 };
 
 class AudioProcessor : public MediaProcessor {
@@ -215,28 +341,234 @@ class AudioProcessor : public MediaProcessor {
   int outDataSize = -1;
   int outSamples = -1;
 
+  // the first decoded frame, a device sized from it waits for it(waitFirstFrame).
+  bool firstFrameSeen = false;  // decoder only.
+  InstrumentedMutex firstFrameMutex{"audio.firstFrame"};
+  InstrumentedCondition firstFrameCv{"audio.firstFrame.wait"};
+  int firstFrameSamples = 0;
+
   ffmpegUtil::AudioInfo inAudio;
   ffmpegUtil::AudioInfo outAudio;
 
+  ffmpegUtil::AudioGain gain{};
+  // measures the decoded audio, before gain and tempo.
+  ffmpegUtil::AudioMeter meter{};
+
+  // playback speed, null at 1.0.
+  std::unique_ptr<ffmpegUtil::AudioTempo> tempoFilter{};
+  std::atomic<double> tempo{1.0};
+
+  // converted audio waiting for the device, the keeper fills it up to queueBytes.
+  ffmpegUtil::SpscRing<uint8_t> ring{};
+  std::atomic<int> queueBytes{0};
+  // the keeper is woken up again when the ring falls below this.
+  std::atomic<int> refillBytes{0};
+  // set by the audio callback, the step is posted by serviceRefill.
+  std::atomic<bool> refillWanted{false};
+  int readAheadMs = 0;
+  int refillMs = 0;
+  // see DownmixMatrix::get, empty for swr's own downmix.
+  string downmixMode{};
+  int deviceSamples = 0;
+  // until the output is configured only one frame is decoded, it is converted again.
+  std::atomic<bool> outputConfigured{false};
+  /*
+   * one pushed chunk: when the data up to endByte was decoded, for measuring the latency,
+   * and the stream position(ms) at endByte, for the clock. A ms of the chunk holds tempo
+   * ms of the stream.
+   */
+  struct DecodeMark {
+    uint64_t endByte;
+    int64_t decodeTimeUs;
+    double endStreamMs;
+    double tempo;
+  };
+  ffmpegUtil::SpscRing<DecodeMark> marks{256};
+  // the last mark the device reached, audio callback only.
+  DecodeMark playedMark{};
+  bool hasPlayedMark = false;
+  uint64_t pushedBytes = 0;  // keeper only.
+  uint64_t poppedBytes = 0;  // audio callback only.
+
+  std::atomic<int64_t> latencyCount{0};
+  std::atomic<int64_t> latencySumUs{0};
+  std::atomic<int64_t> latencyMaxUs{0};
+  std::atomic<int64_t> underruns{0};
+
+  static int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  int frameBytes() const {
+    return outAudio.channels * av_get_bytes_per_sample(outAudio.format);
+  }
+
+  double bytesToMs(size_t bytes) const {
+    return bytes * 1000.0 / ((double)frameBytes() * outAudio.sampleRate);
+  }
+
+  void resetTempoFilter() {
+    double t = tempo.load();
+    bool sameFormat = tempoFilter != nullptr && tempoFilter->audio.format == outAudio.format &&
+                      tempoFilter->audio.layout == outAudio.layout &&
+                      tempoFilter->audio.sampleRate == outAudio.sampleRate;
+    if (sameFormat && tempoFilter->tempo == t) {
+      return;
+    }
+    if (sameFormat) {
+      // the audio the old filter still holds is played at the old speed, not dropped.
+      double oldTempo = tempoFilter->tempo;
+      tempoFilter->drain([this, oldTempo](const uint8_t* data, int size, double endMs) {
+        pushOut(data, size, endMs, oldTempo);
+      });
+    }
+    tempoFilter.reset(t == 1.0 ? nullptr : new ffmpegUtil::AudioTempo(outAudio, t));
+  }
+
+  /*
+   * endMs: the stream position at the end of data, chunkTempo: stream ms per ms of data.
+   */
+  void pushOut(const uint8_t* data, int size, double endMs, double chunkTempo) {
+    size_t pushed = ring.push(data, size);
+    if (pushed < (size_t)size) {
+      LOGW("audio queue full, dropped %d bytes.", size - (int)pushed);
+    }
+    pushedBytes += pushed;
+    // a full mark ring only makes the clock coarser, see streamMsAt.
+    marks.push(DecodeMark{pushedBytes, nowUs(), endMs, chunkTempo});
+  }
+
+  /*
+   * stream position(ms) of byte b of what was pushed, audio callback only, b must not be
+   * behind the marks reached already. Counted back from the end of the chunk holding b.
+   */
+  double streamMsAt(uint64_t b) {
+    DecodeMark next;
+    if (marks.peek(next)) {
+      return next.endStreamMs - bytesToMs((size_t)(next.endByte - b)) * next.tempo;
+    }
+    if (hasPlayedMark) {
+      return playedMark.endStreamMs +
+             bytesToMs((size_t)(b - playedMark.endByte)) * playedMark.tempo;
+    }
+    return 0;
+  }
+
+  /*
+   * the matrix of downmixMode for this file, nullptr for swr's default downmix. A custom
+   * matrix is written for one layout, a file with other channels falls back to the default.
+   */
+  std::shared_ptr<const ffmpegUtil::DownmixMatrix> downmixMatrix() {
+    if (outAudio.channels >= inAudio.channels) {
+      return nullptr;
+    }
+    try {
+      return ffmpegUtil::DownmixMatrix::get(downmixMode, inAudio.layout, outAudio.layout);
+    } catch (const std::runtime_error& e) {
+      cout << "WARN: " << e.what() << ", default downmix of " << inAudio.channels
+           << " channels used." << endl;
+      return nullptr;
+    }
+  }
+
+  void configureOutput(const ffmpegUtil::AudioInfo& output) {
+    outAudio = output;
+    // two seconds or a second more than the read ahead, far more than a frame.
+    int64_t ringMs = std::max(2000, readAheadMs + 1000);
+    ring.reset((size_t)((int64_t)frameBytes() * outAudio.sampleRate * ringMs / 1000));
+    memory.release(MemoryBudget::AUDIO, memory.getHeld(MemoryBudget::AUDIO));
+    memory.charge(MemoryBudget::AUDIO, (int64_t)ring.capacity());
+    // marks of 4ms chunks fill the ring, frames and atempo windows are longer.
+    marks.reset((size_t)ringMs / 4);
+    hasPlayedMark = false;
+    pushedBytes = 0;
+    poppedBytes = 0;
+    if (ffmpegUtil::ReSampler::isPassthrough(inAudio, outAudio)) {
+      reSampler.reset();
+    } else {
+      reSampler.reset(new ffmpegUtil::ReSampler(inAudio, outAudio, downmixMatrix()));
+    }
+    // sized for the new format on the next frame.
+    if (outBuffer != nullptr) {
+      av_freep(&outBuffer);
+    }
+    outBufferSize = -1;
+    meter.configure(outAudio.channels, outAudio.sampleRate);
+    resetTempoFilter();
+    cout << "audio output: format=" << av_get_sample_fmt_name(outAudio.format)
+         << ", channels=" << outAudio.channels << ", rate=" << outAudio.sampleRate
+         << (reSampler == nullptr ? ", passthrough"
+                                  : ", resample, downmix=" + reSampler->describeDownmix())
+         << endl;
+  }
+
  protected:
   void generateNextData(AVFrame* frame) final override {
-    if (outBuffer == nullptr) {
-      outBufferSize = reSampler->allocDataBuf(&outBuffer, frame->nb_samples);
+    if (reSampler == nullptr) {
+      // the device takes the decoder's format, no conversion.
+      int size = av_samples_get_buffer_size(nullptr, outAudio.channels, frame->nb_samples,
+                                            outAudio.format, 1);
+      if (size > outBufferSize) {
+        av_freep(&outBuffer);
+        outBuffer = (uint8_t*)av_malloc(size);
+        outBufferSize = size;
+      }
+      std::memcpy(outBuffer, frame->data[0], size);
+      outSamples = frame->nb_samples;
+      outDataSize = size;
     } else {
-      memset(outBuffer, 0, outBufferSize);
+      // swr writes every byte it reports, no need to clear the buffer.
+      outBufferSize = reSampler->ensureDataBuf(&outBuffer, outBufferSize, frame->nb_samples);
+      std::tie(outSamples, outDataSize) = reSampler->reSample(outBuffer, outBufferSize, frame);
     }
-    std::tie(outSamples, outDataSize) = reSampler->reSample(outBuffer, outBufferSize, frame);
     auto t = frame->pts * av_q2d(streamTimeBase) * 1000;
     nextFrameTimestamp.store((uint64_t)t);
+    if (!firstFrameSeen) {
+      firstFrameSeen = true;
+      {
+        std::lock_guard<InstrumentedMutex> lk{firstFrameMutex};
+        firstFrameSamples = outSamples;
+      }
+      firstFrameCv.notify_all();
+    }
+
+    meter.process(outBuffer, outSamples, outAudio.format);
+    if (tempoFilter == nullptr) {
+      double endMs = t + frame->nb_samples * 1000.0 / inAudio.sampleRate;
+      pushOut(outBuffer, outDataSize, endMs, 1.0);
+    } else {
+      double chunkTempo = tempoFilter->tempo;
+      tempoFilter->process(outBuffer, outSamples, t,
+                           [this, chunkTempo](const uint8_t* data, int size, double endMs) {
+                             pushOut(data, size, endMs, chunkTempo);
+                           });
+    }
   }
 
+  bool isDataFull() override {
+    if (!outputConfigured.load()) {
+      return ring.size() > 0;
+    }
+    return ring.size() >= (size_t)queueBytes.load();
+  }
+
+  // the device plays what is queued.
+  int64_t slackMs() override {
+    if (!outputConfigured.load()) {
+      return 0;
+    }
+    return (int64_t)bytesToMs(ring.size());
+  }
 
 
  public:
   AudioProcessor(const AudioProcessor&) = delete;
   AudioProcessor(AudioProcessor&&) noexcept = delete;
   AudioProcessor operator=(const AudioProcessor&) = delete;
-  ~AudioProcessor() { 
+  ~AudioProcessor() {
+    close();
     if (outBuffer != nullptr) {
       av_freep(&outBuffer);
     }
@@ -244,6 +576,7 @@ class AudioProcessor : public MediaProcessor {
   }
 
   AudioProcessor(AVFormatContext* formatCtx) {
+    setLockNames("audio");
     for (int i = 0; i < formatCtx->nb_streams; i++) {
       if (formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_AUDIO) {
         streamTimeBase = formatCtx->streams[i]->time_base;
@@ -263,37 +596,204 @@ class AudioProcessor : public MediaProcessor {
     int inChannels = codecCtx->channels;
     AVSampleFormat inFormat = codecCtx->sample_fmt;
 
+    if (inLayout <= 0) {
+      inLayout = av_get_default_channel_layout(inChannels);
+    }
+
     inAudio = ffmpegUtil::AudioInfo(inLayout, inSampleRate, inChannels, inFormat);
-    outAudio = ffmpegUtil::ReSampler::getDefaultAudioInfo(inSampleRate);
+    // start with the decoder's own format, the output device may change it by
+    // setOutputAudio before playing.
+    configureOutput(ffmpegUtil::ReSampler::getNativeAudioInfo(inAudio));
+  }
+
+  /*
+   * set the output format to what the audio device accepted, and how much audio is kept
+   * ready on top of the device buffer of deviceSamples.
+   * Must not be called while the device is pulling from this processor.
+   */
+  void setOutputAudio(const ffmpegUtil::AudioInfo& output, int devSamples, int queueSamples) {
+    {
+      std::lock_guard<InstrumentedMutex> lock{nextDataMutex};
+      bool changed = output.format != outAudio.format || output.channels != outAudio.channels ||
+                     output.sampleRate != outAudio.sampleRate || output.layout != outAudio.layout;
+      if (changed) {
+        configureOutput(output);
+      }
+      deviceSamples = devSamples;
+      size_t queue = (size_t)queueSamples * frameBytes();
+      size_t refill = queue;
+      if (readAheadMs > 0) {
+        size_t bytesPerSecond = (size_t)frameBytes() * outAudio.sampleRate;
+        queue = std::max(queue, bytesPerSecond * readAheadMs / 1000);
+        refill = std::max(refill, bytesPerSecond * refillMs / 1000);
+      }
+      queueBytes.store((int)std::min(queue, ring.capacity() - ring.capacity() / 4));
+      refillBytes.store((int)std::min(refill, (size_t)queueBytes.load()));
+      outputConfigured.store(true);
+      if (changed) {
+        regenerateNextData();
+      } else {
+        isNextDataReady.store(isDataFull());
+      }
+    }
+    requestData();
+  }
+
+  const ffmpegUtil::AudioInfo& getOutputAudio() const { return outAudio; }
+
+  /*
+   * decode up to readAhead ms ahead, and sleep until the queue is below refill ms.
+   * For audio only playback, the decoder then wakes up a few times a minute.
+   * Must be called before start().
+   */
+  void setReadAhead(int readAhead, int refill) {
+    readAheadMs = readAhead;
+    refillMs = refill;
+    configureOutput(outAudio);
+  }
 
-    reSampler.reset(new ffmpegUtil::ReSampler(inAudio, outAudio));
+  /*
+   * how more channels than the device has are mixed down: "itu", "dolby", a custom
+   * matrix, or empty for swr's default. Must be called before start().
+   */
+  void setDownmix(const string& mode) {
+    downmixMode = mode;
+    configureOutput(outAudio);
   }
 
+  // decoded audio ready for the device.
+  size_t getQueuedBytes() const { return ring.size(); }
+
+  /*
+   * everything decoded has been handed to the device.
+   */
+  bool isDrained() { return isStreamFinished() && ring.size() == 0; }
+
+  bool isPassthrough() const { return reSampler == nullptr; }
+
   int getAudioIndex() const { return streamIndex; }
 
   int getSamples() { return outSamples; }
 
+  /*
+   * samples of the first decoded frame, woken up by the decoder.
+   * 0 when the stream ended without audio or nothing came within timeoutMs.
+   */
+  int waitFirstFrame(int timeoutMs) {
+    std::unique_lock<InstrumentedMutex> lk{firstFrameMutex};
+    firstFrameCv.wait_for(lk, std::chrono::milliseconds(timeoutMs),
+                          [this] { return firstFrameSamples > 0 || isStreamFinished(); });
+    return firstFrameSamples;
+  }
+
+  /*
+   * volume 1.0 is unity gain, changes are faded in on the audio callback thread.
+   */
+  void setVolume(float v) { gain.setVolume(v); }
+  float getVolume() const { return gain.getVolume(); }
+  void setMute(bool m) { gain.setMute(m); }
+  bool isMuted() const { return gain.isMuted(); }
+  void fadeTo(float v, int ms) { gain.fadeTo(v, ms); }
+
+  /*
+   * playback speed, 0.5 to 4.0, the pitch is kept.
+   * Applies to the audio decoded from now on, what is queued plays at the old speed.
+   */
+  void setTempo(double t) {
+    t = ffmpegUtil::AudioTempo::clamp(t);
+    std::lock_guard<InstrumentedMutex> lock{nextDataMutex};
+    tempo.store(t);
+    resetTempoFilter();
+  }
+
+  double getTempo() const { return tempo.load(); }
+
+  /*
+   * peak, RMS and loudness of the decoded audio, published every 100ms.
+   * The values run ahead of what is heard by the queued audio.
+   */
+  bool getMeterReading(ffmpegUtil::MeterReading& reading) const { return meter.read(reading); }
+  void setMetering(bool enabled) { meter.setEnabled(enabled); }
+
+  /*
+   * audio callback, may run on a real-time thread: no lock and no allocation in here.
+   * A refill is only flagged, serviceRefill posts the decode step.
+   */
   void writeAudioData(uint8_t* stream, int len) {
-    static uint8_t* silenceBuff = nullptr;
-    if (silenceBuff == nullptr) {
-      silenceBuff = (uint8_t*)av_malloc(sizeof(uint8_t) * len);
-      std::memset(silenceBuff, 0, len);
+    size_t got = ring.pop(stream, len);
+    if (got < (size_t)len) {
+      // if queue is empty, silent will be written.
+      std::memset(stream + got, 0, len - got);
+      if (!isStreamFinished()) {
+        underruns++;
+        LOGW("writeAudioData, audio data not ready.");
+      }
     }
+    gain.apply(stream, (int)got, outAudio.format, outAudio.channels, outAudio.sampleRate);
 
-    if (isNextDataReady.load()) {
-      std::lock_guard<std::mutex> lock(nextDataMutex);
-      currentTimestamp.store(nextFrameTimestamp.load());
-      if (outDataSize != len) {
-        cout << "WARNING: outDataSize[" << outDataSize << "] != len[" << len << "]" << endl;
+    size_t queued = ring.size();
+    // the position of what the device starts playing now, tempo changes and the window
+    // atempo keeps back are in the marks.
+    double ts = streamMsAt(poppedBytes);
+    currentTimestamp.store(ts > 0 ? (uint64_t)ts : 0);
+
+    poppedBytes += got;
+    DecodeMark mark;
+    bool reached = false;
+    while (marks.peek(mark) && mark.endByte <= poppedBytes) {
+      marks.pop(mark);
+      reached = true;
+      playedMark = mark;
+      hasPlayedMark = true;
+    }
+    if (reached) {
+      // the last byte of that frame is now in the device buffer.
+      int64_t latency = nowUs() - mark.decodeTimeUs +
+                        (int64_t)deviceSamples * 1000000 / outAudio.sampleRate;
+      latencyCount++;
+      latencySumUs += latency;
+      if (latency > latencyMaxUs.load()) {
+        latencyMaxUs.store(latency);
       }
-      std::memcpy(stream, outBuffer, outDataSize);
+    }
+
+    if (queued < (size_t)refillBytes.load()) {
       isNextDataReady.store(false);
-    } else {
-      // if list is empty, silent will be written.
-      cout << "WARNING: writeAudioData, audio data not ready." << endl;
-      std::memcpy(stream, silenceBuff, len);
+      refillWanted.store(true);
     }
-    cv.notify_one();
+  }
+
+  /*
+   * post the decode step the audio callback asked for, from a normal thread:
+   * the packet reader, or the owner loop of a cooperative item.
+   */
+  void serviceRefill() {
+    if (refillWanted.exchange(false)) {
+      requestData();
+    }
+  }
+
+  // how often serviceRefill must run for a refill to be decoded before the ring runs dry.
+  int refillPeriodMs() const {
+    if (!outputConfigured.load() || refillBytes.load() <= 0) {
+      return 1000;
+    }
+    return std::max(1, (int)bytesToMs((size_t)refillBytes.load()) / 2);
+  }
+
+  /*
+   * decode to device latency since the last call.
+   */
+  AudioLatencyStats getLatencyStats() {
+    AudioLatencyStats stats{};
+    stats.callbacks = latencyCount.exchange(0);
+    int64_t sum = latencySumUs.exchange(0);
+    stats.avgMs = stats.callbacks > 0 ? sum / 1000.0 / stats.callbacks : 0;
+    stats.maxMs = latencyMaxUs.exchange(0) / 1000.0;
+    stats.deviceMs = outAudio.sampleRate > 0 ? deviceSamples * 1000.0 / outAudio.sampleRate : 0;
+    stats.queueMs = bytesToMs(queueBytes.load());
+    stats.underruns = underruns.exchange(0);
+    return stats;
   }
 
   int getInChannels() const {
@@ -336,27 +836,120 @@ class AudioProcessor : public MediaProcessor {
 };
 
 class VideoProcessor : public MediaProcessor {
+  // frames from 720p on are converted in horizontal bands in parallel.
+  static const int SLICE_MIN_PIXELS = 1280 * 720;
+  static const int SLICE_MIN_ROWS = 64;
+  // band edges stay on whole chroma rows of every subsampled format.
+  static const int SLICE_ALIGN = 16;
+
   struct SwsContext* sws_ctx = nullptr;
   AVFrame* outPic = nullptr;
 
+  // one context per band, sws_scale needs the slices of a context in order.
+  struct SwsSlice {
+    struct SwsContext* ctx;
+    int y;
+    int height;
+  };
+  std::vector<SwsSlice> slices{};
+  int srcChromaShift = 0;
+
+  // frames ending before this pts(ms) are late, they are decoded but never converted.
+  std::atomic<uint64_t> dropBeforeMs{0};
+  std::atomic<int64_t> droppedFrames{0};
+  bool lastDropped = false;
+
  protected:
   void generateNextData(AVFrame* frame) override {
     auto t = frame->pts * av_q2d(streamTimeBase) * 1000;
+    uint64_t dropBefore = dropBeforeMs.load();
+    double duration = getFrameRate() > 0 ? 1000 / getFrameRate() : 0;
+    lastDropped = dropBefore > 0 && t + duration < dropBefore;
+    if (lastDropped) {
+      droppedFrames++;
+      return;
+    }
     nextFrameTimestamp.store((uint64_t)t);
-    sws_scale(sws_ctx, (uint8_t const* const*)frame->data, frame->linesize, 0,
-              codecCtx->height, outPic->data, outPic->linesize);
+    if (slices.size() > 1) {
+      TaskExecutor::shared().parallelFor((int)slices.size(),
+                                         [this, frame](int i) { convertSlice(frame, i); });
+    } else {
+      sws_scale(sws_ctx, (uint8_t const* const*)frame->data, frame->linesize, 0,
+                codecCtx->height, outPic->data, outPic->linesize);
+    }
     // unlock nextFrame
   }
 
+  // a dropped frame is not shown, the keeper goes on with the next one.
+  bool isDataFull() override { return !lastDropped; }
+
+  // the frame is asked for when the one shown is taken, it is due a frame later.
+  int64_t slackMs() override {
+    double rate = getFrameRate();
+    return rate > 0 ? (int64_t)(1000 / rate) : 0;
+  }
+
+  void initSlices(int w, int h) {
+    auto desc = av_pix_fmt_desc_get(codecCtx->pix_fmt);
+    int threads = TaskExecutor::shared().threadCount();
+    // palette formats keep the palette in data[1], it must not be offset.
+    if (desc == nullptr || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) ||
+        threads < 2 || (int64_t)w * h < SLICE_MIN_PIXELS) {
+      return;
+    }
+    srcChromaShift = desc->log2_chroma_h;
+    int count = std::min(threads, h / SLICE_MIN_ROWS);
+    int rows = (h / count + SLICE_ALIGN - 1) / SLICE_ALIGN * SLICE_ALIGN;
+    for (int y = 0; y < h; y += rows) {
+      int sh = std::min(rows, h - y);
+      auto ctx = sws_getContext(w, sh, codecCtx->pix_fmt, w, sh, AV_PIX_FMT_YUV420P,
+                                SWS_BILINEAR, NULL, NULL, NULL);
+      if (ctx == nullptr) {
+        freeSlices();
+        return;
+      }
+      slices.push_back(SwsSlice{ctx, y, sh});
+    }
+    cout << "video conversion in " << slices.size() << " slices of " << rows << " rows"
+         << endl;
+  }
+
+  void freeSlices() {
+    for (auto& s : slices) {
+      sws_freeContext(s.ctx);
+    }
+    slices.clear();
+  }
+
+  void convertSlice(const AVFrame* frame, int i) {
+    auto& s = slices[i];
+    const uint8_t* src[4];
+    uint8_t* dst[4];
+    for (int p = 0; p < 4; p++) {
+      bool chroma = p == 1 || p == 2;
+      int srcY = chroma ? s.y >> srcChromaShift : s.y;
+      int dstY = chroma ? s.y / 2 : s.y;
+      src[p] = frame->data[p] != nullptr
+                   ? frame->data[p] + (ptrdiff_t)srcY * frame->linesize[p]
+                   : nullptr;
+      dst[p] = outPic->data[p] != nullptr
+                   ? outPic->data[p] + (ptrdiff_t)dstY * outPic->linesize[p]
+                   : nullptr;
+    }
+    sws_scale(s.ctx, src, frame->linesize, 0, s.height, dst, outPic->linesize);
+  }
+
  public:
   VideoProcessor(const VideoProcessor&) = delete;
   VideoProcessor(VideoProcessor&&) noexcept = delete;
   VideoProcessor operator=(const VideoProcessor&) = delete;
-  ~VideoProcessor() { 
+  ~VideoProcessor() {
+    close();
     if (sws_ctx != nullptr) {
       sws_freeContext(sws_ctx);
       sws_ctx = nullptr;
     }
+    freeSlices();
 
     if (outPic != nullptr) {
       av_frame_free(&outPic);
@@ -365,6 +958,7 @@ class VideoProcessor : public MediaProcessor {
   }
 
   VideoProcessor(AVFormatContext* formatCtx) {
+    setLockNames("video");
     for (int i = 0; i < formatCtx->nb_streams; i++) {
       if (formatCtx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO) {
         streamIndex = i;
@@ -385,21 +979,46 @@ class VideoProcessor : public MediaProcessor {
 
     sws_ctx = sws_getContext(w, h, codecCtx->pix_fmt, w, h, AV_PIX_FMT_YUV420P, SWS_BILINEAR,
                              NULL, NULL, NULL);
+    initSlices(w, h);
 
     int numBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, w, h, 32);
     outPic = av_frame_alloc();
     uint8_t* buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
+    memory.charge(MemoryBudget::FRAMES, numBytes);
     av_image_fill_arrays(outPic->data, outPic->linesize, buffer, AV_PIX_FMT_YUV420P, w, h, 32);
   }
 
   int getVideoIndex() const { return streamIndex; }
 
+  /*
+   * let the decoder skip frames no other frame refers to, e.g. for fast playback.
+   * They are never decoded, the shown frames get further apart.
+   */
+  void setSkipNonRef(bool skip) {
+    std::lock_guard<InstrumentedMutex> lock{nextDataMutex};
+    codecCtx->skip_frame = skip ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+  }
+
+  /*
+   * frames ending before ms are dropped without conversion, 0 keeps every frame.
+   * Set by the player when the video falls behind the clock.
+   */
+  void setDropBefore(uint64_t ms) { dropBeforeMs.store(ms); }
+
+  int64_t getDroppedFrames() const { return droppedFrames.load(); }
+
+  /*
+   * a converted frame is waiting to be shown, getNextPts is its pts(ms).
+   */
+  bool isFrameReady() const { return isNextDataReady.load(); }
+  uint64_t getNextPts() const { return nextFrameTimestamp.load(); }
+
   AVFrame* getFrame() {
     if (isNextDataReady.load()) {
       currentTimestamp.store(nextFrameTimestamp.load());
       return outPic;
     } else {
-      cout << "WARNING: getFrame, video data not ready." << endl;
+      LOGW("getFrame, video data not ready.");
       return nullptr;
     }
   }
@@ -408,10 +1027,10 @@ class VideoProcessor : public MediaProcessor {
     if (isNextDataReady.load()) {
       currentTimestamp.store(nextFrameTimestamp.load());
       isNextDataReady.store(false);
-      cv.notify_one();
+      requestData();
       return true;
     } else {
-      cv.notify_one();
+      requestData();
       return false;
     }
   }
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// from this share of the limit on, only streams within their fair share may grow.
+const double MEMORY_SOFT_LIMIT = 0.9;
+
+/*
+ * Bytes held in the queues of every stream of the process: packets waiting for a decoder,
+ * converted frames and audio rings. Each processor has an Account.
+ *
+ * Fixed buffers(frames, rings) are charged when allocated, a stream that can not fit is
+ * refused when it is opened. Packets are flow controlled: a stream may take more only
+ * while the total is under the limit, and above MEMORY_SOFT_LIMIT only while it holds no
+ * more than its fair share, so the biggest consumers are throttled first and drain by
+ * decoding while the small ones keep playing. The reader holds a refused packet and
+ * reads nothing else until its stream may take it. Every stream may always hold one
+ * packet, so nothing stalls; only that first packet of a stream can pass the limit.
+ */
+class MemoryBudget {
+ public:
+  enum Kind { PACKETS = 0, FRAMES = 1, AUDIO = 2, KIND_COUNT = 3 };
+
+  class Account {
+    MemoryBudget& budget;
+    std::string name;
+    std::atomic<int64_t> held[KIND_COUNT];
+    std::atomic<int64_t> throttled{0};
+    friend class MemoryBudget;
+
+   public:
+    explicit Account(const std::string& n, MemoryBudget& b = MemoryBudget::shared())
+        : budget(b), name(n) {
+      for (auto& h : held) {
+        h.store(0);
+      }
+      budget.add(this);
+    }
+
+    Account(const Account&) = delete;
+    Account& operator=(const Account&) = delete;
+
+    ~Account() {
+      for (int k = 0; k < KIND_COUNT; k++) {
+        release((Kind)k, held[k].load());
+      }
+      budget.remove(this);
+    }
+
+    void setName(const std::string& n) {
+      std::lock_guard<std::mutex> lk{budget.mtx};
+      name = n;
+    }
+
+    void charge(Kind kind, int64_t bytes) {
+      held[kind] += bytes;
+      budget.used += bytes;
+      int64_t used = budget.used.load();
+      int64_t peak = budget.peak.load();
+      while (used > peak && !budget.peak.compare_exchange_weak(peak, used)) {
+      }
+    }
+
+    void release(Kind kind, int64_t bytes) {
+      held[kind] -= bytes;
+      budget.used -= bytes;
+    }
+
+    int64_t getHeld() const {
+      int64_t sum = 0;
+      for (auto& h : held) {
+        sum += h.load();
+      }
+      return sum;
+    }
+
+    int64_t getHeld(Kind kind) const { return held[kind].load(); }
+
+    /*
+     * whether this stream may queue about bytes more packets.
+     */
+    bool canGrow(int64_t bytes) {
+      if (budget.allows(*this, bytes)) {
+        return true;
+      }
+      throttled++;
+      return false;
+    }
+  };
+
+ private:
+  std::mutex mtx{};
+  std::vector<Account*> accounts{};
+  std::atomic<int64_t> limit{0};
+  std::atomic<int64_t> used{0};
+  std::atomic<int64_t> peak{0};
+
+  void add(Account* a) {
+    std::lock_guard<std::mutex> lk{mtx};
+    accounts.push_back(a);
+  }
+
+  void remove(Account* a) {
+    std::lock_guard<std::mutex> lk{mtx};
+    accounts.erase(std::remove(accounts.begin(), accounts.end(), a), accounts.end());
+  }
+
+  bool allows(const Account& a, int64_t bytes) {
+    int64_t max = limit.load();
+    if (max <= 0 || a.held[PACKETS].load() == 0) {
+      return true;
+    }
+    int64_t after = used.load() + bytes;
+    if (after > max) {
+      return false;
+    }
+    if (after > (int64_t)(max * MEMORY_SOFT_LIMIT)) {
+      std::lock_guard<std::mutex> lk{mtx};
+      int64_t fairShare = max / std::max((size_t)1, accounts.size());
+      return a.getHeld() <= fairShare;
+    }
+    return true;
+  }
+
+ public:
+  MemoryBudget() = default;
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  static MemoryBudget& shared() {
+    static MemoryBudget budget{};
+    return budget;
+  }
+
+  // bytes, 0 for no limit.
+  void setLimit(int64_t bytes) { limit.store(bytes); }
+  int64_t getLimit() const { return limit.load(); }
+  int64_t getUsed() const { return used.load(); }
+  int64_t getPeak() const { return peak.load(); }
+
+  // over the limit, no new stream is admitted.
+  bool isExhausted() const {
+    int64_t max = limit.load();
+    return max > 0 && used.load() > max;
+  }
+
+  // live usage of every account, biggest first.
+  void printUsage() {
+    std::lock_guard<std::mutex> lk{mtx};
+    std::vector<Account*> sorted = accounts;
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Account* x, const Account* y) { return x->getHeld() > y->getHeld(); });
+    const double MB = 1024.0 * 1024.0;
+    std::cout << "memory: used=" << used.load() / MB << "MB, peak=" << peak.load() / MB
+              << "MB, limit=" << (limit.load() > 0 ? limit.load() / MB : 0) << "MB"
+              << std::endl;
+    for (auto a : sorted) {
+      std::cout << "  " << a->name << ": packets=" << a->held[PACKETS].load() / MB
+                << "MB, frames=" << a->held[FRAMES].load() / MB
+                << "MB, audio=" << a->held[AUDIO].load() / MB
+                << "MB, throttled=" << a->throttled.load() << std::endl;
+    }
+  }
+};
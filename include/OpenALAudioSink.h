@@ -0,0 +1,357 @@
+#pragma once
+
+#include "AudioSink.h"
+#include "MediaProcessor.hpp"
+#include "ThreadPolicy.h"
+
+#include "OpenAL/alc.h"
+#include "OpenAL/al.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * OpenAL streaming output.
+ *
+ * A feeder thread keeps a number of OpenAL buffers queued on one source. The number
+ * adapts: it grows after the source ran dry, and shrinks again after a quiet period,
+ * so the queue stays as short as the machine allows.
+ * The clock comes from AL_SAMPLE_OFFSET of the buffer being played.
+ */
+class OpenALAudioSink : public AudioSink {
+  static const int MAX_BUFFERS = 32;
+  static const int MIN_BUFFERS = 2;
+  // one underrun free period, after which a buffer is taken away again.
+  static const int SHRINK_AFTER_MS = 10000;
+
+  struct QueuedBuffer {
+    ALuint id;
+    uint64_t ptsMs;
+    // a ms of the buffer holds tempo ms of the stream.
+    double tempo;
+  };
+
+  ALCdevice* device = nullptr;
+  ALCcontext* context = nullptr;
+  ALuint sourceId = 0;
+  ALuint bufferIds[MAX_BUFFERS];
+  std::deque<ALuint> freeBuffers{};
+  std::deque<QueuedBuffer> queuedBuffers{};
+  // guards the AL source, the buffer lists and the source pointer for the feeder.
+  std::mutex mtx{};
+  // the feeder is parked on it while paused.
+  std::condition_variable pauseCv{};
+  bool paused = false;
+
+  std::atomic<AudioProcessor*> source{nullptr};
+  ffmpegUtil::AudioInfo deviceAudio{};
+  ALenum alFormat = AL_FORMAT_STEREO16;
+  int bufferSamples = 0;
+  std::vector<uint8_t> chunk{};
+
+  const int latencyMs;
+  int targetBuffers = 4;
+  int64_t underruns = 0;
+  int64_t grows = 0;
+  int64_t shrinks = 0;
+  std::chrono::steady_clock::time_point lastUnderrun{};
+  uint64_t lastClockMs = 0;
+  // playing a stream, running dry from here on is an underrun.
+  bool started = false;
+
+  std::atomic<bool> running{false};
+  std::thread feeder{};
+
+  /*
+   * the closest format OpenAL takes, float and multichannel need the AL extensions.
+   * alEnum gets the AL format of it.
+   */
+  static ffmpegUtil::AudioInfo chooseFormat(const ffmpegUtil::AudioInfo& native,
+                                            ALenum& alEnum) {
+    bool isFloat = native.format == AV_SAMPLE_FMT_FLT &&
+                   alIsExtensionPresent("AL_EXT_FLOAT32") == AL_TRUE;
+    int channels = native.channels;
+    ALenum format = 0;
+    if (channels > 2 && alIsExtensionPresent("AL_EXT_MCFORMATS") == AL_TRUE) {
+      const char* name = nullptr;
+      switch (channels) {
+        case 4:
+          name = isFloat ? "AL_FORMAT_QUAD32" : "AL_FORMAT_QUAD16";
+          break;
+        case 6:
+          name = isFloat ? "AL_FORMAT_51CHN32" : "AL_FORMAT_51CHN16";
+          break;
+        case 7:
+          name = isFloat ? "AL_FORMAT_61CHN32" : "AL_FORMAT_61CHN16";
+          break;
+        case 8:
+          name = isFloat ? "AL_FORMAT_71CHN32" : "AL_FORMAT_71CHN16";
+          break;
+        default:
+          break;
+      }
+      format = name != nullptr ? alGetEnumValue(name) : 0;
+    } else if (channels <= 2 && isFloat) {
+      format = alGetEnumValue(channels == 1 ? "AL_FORMAT_MONO_FLOAT32"
+                                            : "AL_FORMAT_STEREO_FLOAT32");
+    } else if (channels <= 2) {
+      format = channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+    }
+
+    if (format == 0 || format == -1) {
+      // not supported, downmix to stereo S16 which every implementation takes.
+      isFloat = false;
+      channels = 2;
+      format = AL_FORMAT_STEREO16;
+    }
+    alEnum = format;
+    int64_t layout = channels == native.channels ? native.layout
+                                                 : av_get_default_channel_layout(channels);
+    return ffmpegUtil::AudioInfo(layout, native.sampleRate, channels,
+                                 isFloat ? AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_S16);
+  }
+
+  void open() {
+    device = alcOpenDevice(nullptr);
+    if (device == nullptr) {
+      throw std::runtime_error("OpenAL: can not open device.");
+    }
+    context = alcCreateContext(device, nullptr);
+    alcMakeContextCurrent(context);
+    if (alcGetError(device) != ALC_NO_ERROR) {
+      throw std::runtime_error("OpenAL: can not create context.");
+    }
+
+    alGenSources(1, &sourceId);
+    alGenBuffers(MAX_BUFFERS, bufferIds);
+    if (alGetError() != AL_NO_ERROR) {
+      throw std::runtime_error("OpenAL: can not generate source and buffers.");
+    }
+    alSourcef(sourceId, AL_PITCH, 1.0);
+    alSourcef(sourceId, AL_GAIN, 1.0);
+    alSourcei(sourceId, AL_LOOPING, AL_FALSE);
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+      freeBuffers.push_back(bufferIds[i]);
+    }
+
+    // the first shrink waits for a whole underrun free period too.
+    lastUnderrun = std::chrono::steady_clock::now();
+    running.store(true);
+    feeder = std::thread{&OpenALAudioSink::feedLoop, this};
+  }
+
+  int bufferMs() const { return bufferSamples * 1000 / deviceAudio.sampleRate; }
+
+  // stream ms in deviceMs of a buffer played at tempo.
+  static uint64_t streamMs(double deviceMs, double tempo) {
+    return (uint64_t)(deviceMs * tempo);
+  }
+
+  void reclaimProcessed() {
+    ALint processed = 0;
+    alGetSourcei(sourceId, AL_BUFFERS_PROCESSED, &processed);
+    while (processed-- > 0 && !queuedBuffers.empty()) {
+      ALuint id = 0;
+      alSourceUnqueueBuffers(sourceId, 1, &id);
+      const QueuedBuffer& played = queuedBuffers.front();
+      lastClockMs = played.ptsMs + streamMs(bufferMs(), played.tempo);
+      queuedBuffers.pop_front();
+      freeBuffers.push_back(id);
+    }
+  }
+
+  void adapt(bool starved) {
+    auto now = std::chrono::steady_clock::now();
+    if (starved) {
+      underruns++;
+      lastUnderrun = now;
+      if (targetBuffers < MAX_BUFFERS) {
+        int grown = targetBuffers + std::max(1, targetBuffers / 2);
+        targetBuffers = std::min((int)MAX_BUFFERS, grown);
+        grows++;
+        LOGW("OpenALAudioSink: underrun, queue %d buffers.", targetBuffers);
+      }
+    } else if (targetBuffers > MIN_BUFFERS &&
+               now - lastUnderrun > std::chrono::milliseconds((int)SHRINK_AFTER_MS)) {
+      targetBuffers--;
+      shrinks++;
+      lastUnderrun = now;
+    }
+  }
+
+  void feedLoop() {
+    ThreadPolicy::shared().apply("lp-audio-feed", ThreadRole::AUDIO);
+    cout << "[THREAD] OpenAL feeder started." << endl;
+    while (running.load()) {
+      {
+        std::unique_lock<std::mutex> lk{mtx};
+        pauseCv.wait(lk, [this] { return !paused || !running.load(); });
+        reclaimProcessed();
+
+        AudioProcessor* receiver = source.load();
+        if (receiver != nullptr) {
+          while ((int)queuedBuffers.size() < targetBuffers && !freeBuffers.empty()) {
+            // only whole buffers of real data, a dry queue shows up as an underrun.
+            if (receiver->getQueuedBytes() < chunk.size() && !receiver->isStreamFinished()) {
+              break;
+            }
+            if (receiver->isDrained()) {
+              break;
+            }
+            receiver->writeAudioData(chunk.data(), (int)chunk.size());
+            ALuint id = freeBuffers.front();
+            freeBuffers.pop_front();
+            alBufferData(id, alFormat, chunk.data(), (ALsizei)chunk.size(),
+                         deviceAudio.sampleRate);
+            alSourceQueueBuffers(sourceId, 1, &id);
+            queuedBuffers.push_back(
+                QueuedBuffer{id, receiver->getPts(), receiver->getTempo()});
+          }
+        }
+
+        ALint state = 0;
+        alGetSourcei(sourceId, AL_SOURCE_STATE, &state);
+        if (state != AL_PLAYING && !queuedBuffers.empty()) {
+          // stopped with data queued again: it had run dry in the middle of a stream.
+          adapt(started && state == AL_STOPPED);
+          alSourcePlay(sourceId);
+          started = true;
+        } else if (state == AL_PLAYING) {
+          adapt(false);
+        } else if (receiver == nullptr || receiver->isStreamFinished()) {
+          // drained at the end of the stream, the next one starts fresh.
+          started = false;
+        }
+      }
+      // OpenAL has no callback, poll twice per buffer.
+      int period = bufferSamples > 0 ? std::max(1, bufferMs() / 2) : 10;
+      std::this_thread::sleep_for(std::chrono::milliseconds(period));
+    }
+    cout << "[THREAD] OpenAL feeder finished." << endl;
+  }
+
+  void stopSource() {
+    alSourceStop(sourceId);
+    reclaimProcessed();
+    // a stopped source has processed all its buffers.
+    for (auto& q : queuedBuffers) {
+      freeBuffers.push_back(q.id);
+    }
+    queuedBuffers.clear();
+    alSourcei(sourceId, AL_BUFFER, 0);
+    started = false;
+  }
+
+ public:
+  /*
+   * latency: target of the whole queue in ms, 0 for the default of 4 buffers of 20ms.
+   */
+  explicit OpenALAudioSink(int latency = 0) : latencyMs(latency) {}
+  OpenALAudioSink(const OpenALAudioSink&) = delete;
+  OpenALAudioSink& operator=(const OpenALAudioSink&) = delete;
+
+  ~OpenALAudioSink() { close(); }
+
+  const char* getName() const override { return "openal"; }
+
+  void attach(AudioProcessor& aProcessor) override {
+    if (device == nullptr) {
+      open();
+    }
+    ALenum format = 0;
+    ffmpegUtil::AudioInfo wanted = chooseFormat(aProcessor.getOutputAudio(), format);
+
+    std::lock_guard<std::mutex> lg{mtx};
+    bool reuse = bufferSamples > 0 && wanted.sampleRate == deviceAudio.sampleRate &&
+                 wanted.channels == deviceAudio.channels && wanted.format == deviceAudio.format;
+    if (!reuse) {
+      stopSource();
+      // the feeder fills buffers with the format under the lock, both change together.
+      deviceAudio = wanted;
+      alFormat = format;
+      int bufferTargetMs = latencyMs > 0 ? std::max(5, latencyMs / targetBuffers) : 20;
+      bufferSamples = deviceAudio.sampleRate * bufferTargetMs / 1000;
+      chunk.resize((size_t)bufferSamples * deviceAudio.channels *
+                   av_get_bytes_per_sample(deviceAudio.format));
+    }
+    // the queued AL buffers are the device buffer, the processor keeps one more ready.
+    aProcessor.setOutputAudio(deviceAudio, bufferSamples * targetBuffers, bufferSamples);
+    source.store(&aProcessor);
+    cout << "OpenALAudioSink: " << (reuse ? "reuse source" : "new source") << ", format=0x"
+         << std::hex << alFormat << std::dec << ", buffer=" << bufferMs() << "ms x "
+         << targetBuffers << endl;
+  }
+
+  void detach() override {
+    std::lock_guard<std::mutex> lg{mtx};
+    source.store(nullptr);
+  }
+
+  void setPaused(bool p) override {
+    {
+      std::lock_guard<std::mutex> lg{mtx};
+      paused = p;
+      if (device != nullptr) {
+        // a paused source keeps its buffers and position.
+        ALint state = 0;
+        alGetSourcei(sourceId, AL_SOURCE_STATE, &state);
+        if (paused && state == AL_PLAYING) {
+          alSourcePause(sourceId);
+        } else if (!paused && state == AL_PAUSED) {
+          alSourcePlay(sourceId);
+        }
+      }
+    }
+    pauseCv.notify_all();
+  }
+
+  void close() override {
+    if (feeder.joinable()) {
+      {
+        std::lock_guard<std::mutex> lg{mtx};
+        running.store(false);
+      }
+      pauseCv.notify_all();
+      feeder.join();
+    }
+    if (device == nullptr) {
+      return;
+    }
+    stopSource();
+    alDeleteSources(1, &sourceId);
+    alDeleteBuffers(MAX_BUFFERS, bufferIds);
+    freeBuffers.clear();
+    alcMakeContextCurrent(nullptr);
+    alcDestroyContext(context);
+    alcCloseDevice(device);
+    context = nullptr;
+    device = nullptr;
+  }
+
+  /*
+   * pts of the buffer being played plus the offset inside it, as heard.
+   */
+  uint64_t getClockMs() override {
+    std::lock_guard<std::mutex> lg{mtx};
+    if (queuedBuffers.empty() || deviceAudio.sampleRate <= 0) {
+      return lastClockMs;
+    }
+    ALint offset = 0;
+    alGetSourcei(sourceId, AL_SAMPLE_OFFSET, &offset);
+    const QueuedBuffer& playing = queuedBuffers.front();
+    return playing.ptsMs + streamMs(offset * 1000.0 / deviceAudio.sampleRate, playing.tempo);
+  }
+
+  void printStats() override {
+    std::lock_guard<std::mutex> lg{mtx};
+    cout << "OpenALAudioSink: buffer=" << bufferMs() << "ms, queued target=" << targetBuffers
+         << ", underruns=" << underruns << ", grows=" << grows << ", shrinks=" << shrinks
+         << endl;
+  }
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavcodec/avcodec.h>
+#ifdef __cplusplus
+};
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+/*
+ * AVPacket structs of every stream of the process, reused instead of allocated per packet.
+ * The reader takes one for each packet it reads, the decoder gives it back once sent.
+ * Only the struct is pooled, the data stays refcounted by FFmpeg and is unref'd on release.
+ * Up to MAX_FREE spare packets are kept, a wall of many items shares the same ones.
+ */
+class PacketPool {
+  static const int MAX_FREE = 256;
+
+  std::mutex mtx{};
+  std::vector<AVPacket*> freePackets{};
+  std::atomic<int64_t> allocated{0};
+  std::atomic<int64_t> reused{0};
+
+ public:
+  PacketPool() = default;
+  PacketPool(const PacketPool&) = delete;
+  PacketPool& operator=(const PacketPool&) = delete;
+
+  ~PacketPool() {
+    for (auto p : freePackets) {
+      av_packet_free(&p);
+    }
+  }
+
+  static PacketPool& shared() {
+    static PacketPool pool{};
+    return pool;
+  }
+
+  // a blank packet, nullptr when out of memory.
+  AVPacket* acquire() {
+    {
+      std::lock_guard<std::mutex> lk{mtx};
+      if (!freePackets.empty()) {
+        AVPacket* p = freePackets.back();
+        freePackets.pop_back();
+        reused++;
+        return p;
+      }
+    }
+    allocated++;
+    return av_packet_alloc();
+  }
+
+  // unref the data and keep the struct, packet is null afterwards.
+  void release(AVPacket*& packet) {
+    if (packet == nullptr) {
+      return;
+    }
+    av_packet_unref(packet);
+    {
+      std::lock_guard<std::mutex> lk{mtx};
+      if ((int)freePackets.size() < MAX_FREE) {
+        freePackets.push_back(packet);
+        packet = nullptr;
+        return;
+      }
+    }
+    av_packet_free(&packet);
+  }
+
+  void printStats() const {
+    std::cout << "packet pool: allocated=" << allocated.load() << ", reused=" << reused.load()
+              << std::endl;
+  }
+};
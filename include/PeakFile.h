@@ -0,0 +1,169 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ffmpegUtil {
+
+/*
+ * Waveform overview sidecar layout(little endian, no padding):
+ *
+ *   PeakFileHeader
+ *   PeakLevelEntry * header.levelCount    (finest level first)
+ *   PeakBin * level.binCount * header.channels, for every level at level.offset
+ *
+ * Bins of a level are interleaved by channel: bin i of channel c is at i * channels + c.
+ * The file is used directly from a read-only mapping.
+ */
+struct PeakFileHeader {
+  char magic[4];  // "LPWF"
+  uint32_t version;
+  int32_t sampleRate;
+  int32_t channels;
+  int64_t inputSize;  // size of the summarized file, to detect stale sidecars.
+  int64_t totalFrames;
+  uint32_t levelCount;
+  uint32_t reserved;
+};
+
+struct PeakLevelEntry {
+  uint32_t framesPerBin;
+  uint32_t reserved;
+  uint64_t binCount;
+  uint64_t offset;  // from the start of the file.
+};
+
+// S16 scale, rms is never negative.
+struct PeakBin {
+  int16_t min;
+  int16_t max;
+  int16_t rms;
+};
+
+static_assert(sizeof(PeakFileHeader) == 40, "PeakFileHeader layout changed.");
+static_assert(sizeof(PeakLevelEntry) == 24, "PeakLevelEntry layout changed.");
+static_assert(sizeof(PeakBin) == 6, "PeakBin layout changed.");
+
+class PeakFile {
+  static const uint32_t VERSION = 1;
+
+  PeakFileHeader header{};
+  MappedFile mapped{};
+  const PeakLevelEntry* levels = nullptr;
+
+ public:
+  struct Level {
+    uint32_t framesPerBin;
+    std::vector<PeakBin> bins;
+  };
+
+  PeakFile() = default;
+  PeakFile(const PeakFile&) = delete;
+  PeakFile& operator=(const PeakFile&) = delete;
+
+  static string sidecarPath(const string& inputPath) { return inputPath + ".lpwf"; }
+
+  static bool save(const string& path, int sampleRate, int channels, int64_t inputSize,
+                   int64_t totalFrames, const std::vector<Level>& data) {
+    PeakFileHeader h{};
+    std::memcpy(h.magic, "LPWF", 4);
+    h.version = VERSION;
+    h.sampleRate = sampleRate;
+    h.channels = channels;
+    h.inputSize = inputSize;
+    h.totalFrames = totalFrames;
+    h.levelCount = (uint32_t)data.size();
+
+    std::vector<PeakLevelEntry> entries(data.size());
+    uint64_t offset = sizeof(h) + sizeof(PeakLevelEntry) * data.size();
+    for (size_t i = 0; i < data.size(); i++) {
+      entries[i].framesPerBin = data[i].framesPerBin;
+      entries[i].binCount = data[i].bins.size() / channels;
+      entries[i].offset = offset;
+      offset += sizeof(PeakBin) * data[i].bins.size();
+    }
+
+    std::ofstream os{path, std::ios::binary | std::ios::trunc};
+    if (!os) {
+      cout << "WARN: can not write peak file: " << path << endl;
+      return false;
+    }
+    os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    os.write(reinterpret_cast<const char*>(entries.data()),
+             sizeof(PeakLevelEntry) * entries.size());
+    for (auto& level : data) {
+      os.write(reinterpret_cast<const char*>(level.bins.data()),
+               sizeof(PeakBin) * level.bins.size());
+    }
+    return os.good();
+  }
+
+  /*
+   * Map a sidecar file, return nullptr if it is missing or broken.
+   * inputSize < 0 skips the check for a stale file.
+   */
+  static std::unique_ptr<PeakFile> load(const string& path, int64_t inputSize = -1) {
+    std::unique_ptr<PeakFile> peaks{new PeakFile()};
+    if (!peaks->mapped.map(path)) {
+      return nullptr;
+    }
+    auto data = peaks->mapped.data();
+    auto size = peaks->mapped.size();
+    if (size < sizeof(PeakFileHeader)) {
+      return nullptr;
+    }
+    auto& h = peaks->header;
+    std::memcpy(&h, data, sizeof(h));
+    if (std::memcmp(h.magic, "LPWF", 4) != 0 || h.version != VERSION || h.channels <= 0 ||
+        size < sizeof(h) + sizeof(PeakLevelEntry) * h.levelCount) {
+      cout << "WARN: invalid peak file: " << path << endl;
+      return nullptr;
+    }
+    if (inputSize >= 0 && h.inputSize != inputSize) {
+      cout << "WARN: stale peak file: " << path << endl;
+      return nullptr;
+    }
+    peaks->levels = reinterpret_cast<const PeakLevelEntry*>(data + sizeof(h));
+    for (uint32_t i = 0; i < h.levelCount; i++) {
+      auto& l = peaks->levels[i];
+      if (l.offset + sizeof(PeakBin) * l.binCount * h.channels > size) {
+        cout << "WARN: truncated peak file: " << path << endl;
+        return nullptr;
+      }
+    }
+    return peaks;
+  }
+
+  int getSampleRate() const { return header.sampleRate; }
+  int getChannels() const { return header.channels; }
+  int64_t getTotalFrames() const { return header.totalFrames; }
+  size_t levelCount() const { return header.levelCount; }
+  const PeakLevelEntry& level(size_t i) const { return levels[i]; }
+
+  const PeakBin* bins(size_t i) const {
+    return reinterpret_cast<const PeakBin*>(mapped.data() + levels[i].offset);
+  }
+
+  /*
+   * the coarsest level that still has at least one bin per pixel, for a view of
+   * framesPerPixel frames per pixel.
+   */
+  size_t levelFor(int64_t framesPerPixel) const {
+    size_t best = 0;
+    for (size_t i = 0; i < header.levelCount; i++) {
+      if (levels[i].framesPerBin <= framesPerPixel) {
+        best = i;
+      }
+    }
+    return best;
+  }
+};
+
+}  // namespace ffmpegUtil
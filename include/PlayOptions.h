@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+/*
+ * Options from command line, shared by main and the players.
+ */
+struct PlayOptions {
+  // start playing from this position, in milliseconds.
+  int64_t startMs = 0;
+
+  // how many segments of a '.seglist' input are opened ahead of the playing one.
+  int segmentPrefetch = 2;
+
+  // play the audio only, even when there is a video stream.
+  bool noVideo = false;
+
+  // the audio of a file with video is not decoded, for players without an audio device.
+  bool noAudio = false;
+
+  // output gain, 1.0 is unity.
+  float volume = 1.0f;
+  bool mute = false;
+
+  // audio output latency target in ms, split between the device buffer and the decoded
+  // queue. 0: the device buffer is one decoded frame.
+  int audioLatencyMs = 0;
+
+  // audio output backend: "sdl" or "openal".
+  std::string audioSink = "sdl";
+
+  // demux, decode and conversion are run by the loop of the player, no reader thread and
+  // no decode workers. Needs a cooperative shared executor, see TaskExecutor.
+  bool cooperative = false;
+
+  // playback speed, 0.5 to 4.0, the audio keeps its pitch.
+  double speed = 1.0;
+
+  // downmix of multichannel audio, see DownmixMatrix::get. Per file when given for it.
+  std::string downmix{};
+  std::map<std::string, std::string> fileDownmix{};
+
+  const std::string& downmixFor(const std::string& file) const {
+    auto it = fileDownmix.find(file);
+    return it != fileDownmix.end() ? it->second : downmix;
+  }
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "AudioSink.h"
+#include "MediaItem.h"
+#include "PlayOptions.h"
+#include "VideoWall.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+/*
+ * One player of a wall: its own pipeline and clock, showing into one tile.
+ * It has no thread and no event loop of its own, the wall calls refresh for every
+ * player on each of its refreshes. Everything is per instance, any number can run
+ * in one process: decoding runs on the shared executor, audio goes to an input of the
+ * shared mixer.
+ */
+class Player {
+  // a frame this early is shown on this refresh, it would be late on the next one.
+  static const int EARLY_MS = 8;
+  // frames further behind the clock are dropped before conversion.
+  static const int LATE_MS = 100;
+
+  std::unique_ptr<ffmpegUtil::MediaItem> item{};
+  AudioSink* audioSink = nullptr;
+  const int tile;
+  const double speed;
+
+  // video without audio runs on the steady clock from its first frame.
+  uint64_t baseMs = 0;
+  int64_t baseTicksMs = -1;
+  int64_t pausedAtMs = -1;
+  int64_t shownFrames = 0;
+
+  static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // the position to show, the first frame starts the steady clock.
+  uint64_t clockMs(uint64_t framePts) {
+    if (audioSink != nullptr) {
+      return audioSink->getClockMs();
+    }
+    if (baseTicksMs < 0) {
+      baseMs = framePts;
+      baseTicksMs = nowMs();
+    }
+    return baseMs + (uint64_t)((nowMs() - baseTicksMs) * speed);
+  }
+
+ public:
+  /*
+   * sink may be null to play without sound.
+   */
+  Player(const string& inputFile, const PlayOptions& options, AudioSink* sink, int tileIndex)
+      : tile(tileIndex), speed(options.speed) {
+    item = ffmpegUtil::openMediaItem(inputFile, options);
+    if (sink != nullptr && item->audioProcessor != nullptr) {
+      audioSink = sink;
+      audioSink->attach(*item->audioProcessor);
+    }
+  }
+
+  Player(const Player&) = delete;
+  Player& operator=(const Player&) = delete;
+
+  // the sink stops pulling before the pipeline goes away.
+  ~Player() {
+    if (audioSink != nullptr) {
+      audioSink->detach();
+    }
+    item.reset();
+  }
+
+  const string& getInputFile() const { return item->inputFile; }
+
+  bool isFinished() const {
+    if (item->videoProcessor != nullptr) {
+      return item->videoProcessor->isStreamFinished() && !item->videoProcessor->isFrameReady();
+    }
+    // audio only without a sink has nothing to wait for.
+    return audioSink == nullptr || item->audioProcessor->isDrained();
+  }
+
+  /*
+   * show the next frame on the target if it is due.
+   *  return
+   *          true   : a new frame was shown
+   */
+  bool refresh(VideoTarget& target) {
+    auto video = item->videoProcessor.get();
+    if (pausedAtMs >= 0 || video == nullptr || !video->isFrameReady()) {
+      return false;
+    }
+    uint64_t framePts = video->getNextPts();
+    uint64_t clock = clockMs(framePts);
+    if (framePts > clock + EARLY_MS) {
+      return false;
+    }
+    video->setDropBefore(clock > framePts + LATE_MS ? clock : 0);
+
+    AVFrame* frame = video->getFrame();
+    if (frame == nullptr) {
+      return false;
+    }
+    target.show(tile, frame, video->getWidth(), video->getHeight());
+    video->refreshFrame();
+    shownFrames++;
+    return true;
+  }
+
+  /*
+   * wall time until refresh would show the next frame, 0 when it is due or not decoded yet.
+   */
+  int64_t untilNextFrameMs() {
+    auto video = item->videoProcessor.get();
+    if (pausedAtMs >= 0 || video == nullptr || !video->isFrameReady()) {
+      return 0;
+    }
+    uint64_t framePts = video->getNextPts();
+    uint64_t clock = clockMs(framePts);
+    if (framePts <= clock + EARLY_MS) {
+      return 0;
+    }
+    return (int64_t)((framePts - clock - EARLY_MS) / speed);
+  }
+
+  // cooperative: read the packets the decoders need, see MediaItem::readStep.
+  void readStep() {
+    if (pausedAtMs < 0) {
+      item->readStep();
+    }
+  }
+
+  /*
+   * park the pipeline and the audio input, the steady clock skips the paused time.
+   */
+  void setPaused(bool paused) {
+    if (paused == (pausedAtMs >= 0)) {
+      return;
+    }
+    item->setPaused(paused);
+    if (audioSink != nullptr) {
+      audioSink->setPaused(paused);
+    }
+    if (paused) {
+      pausedAtMs = nowMs();
+    } else {
+      if (baseTicksMs >= 0) {
+        baseTicksMs += nowMs() - pausedAtMs;
+      }
+      pausedAtMs = -1;
+    }
+  }
+
+  void printStats() const {
+    cout << "player [" << tile << "] " << item->inputFile << ": shown=" << shownFrames;
+    if (item->videoProcessor != nullptr) {
+      cout << ", dropped=" << item->videoProcessor->getDroppedFrames();
+    }
+    cout << endl;
+  }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/*
+ * CPU time and context switches of the whole process since construction, to compare
+ * the threaded and the cooperative pipeline under the same limits.
+ * Context switches are not counted on Windows.
+ */
+class ProcessUsage {
+  struct Sample {
+    int64_t cpuUs = 0;
+    int64_t voluntary = 0;
+    int64_t involuntary = 0;
+    std::chrono::steady_clock::time_point at{};
+  };
+
+  Sample start{};
+
+  static Sample now() {
+    Sample s{};
+    s.at = std::chrono::steady_clock::now();
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+      auto ticks = [](const FILETIME& t) {
+        return ((int64_t)t.dwHighDateTime << 32) | t.dwLowDateTime;
+      };
+      // 100ns units.
+      s.cpuUs = (ticks(kernel) + ticks(user)) / 10;
+    }
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+      s.cpuUs = (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+                usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+      s.voluntary = usage.ru_nvcsw;
+      s.involuntary = usage.ru_nivcsw;
+    }
+#endif
+    return s;
+  }
+
+ public:
+  ProcessUsage() : start(now()) {}
+
+  void print(const std::string& what) const {
+    Sample end = now();
+    double wallMs =
+        std::chrono::duration<double, std::milli>(end.at - start.at).count();
+    double cpuMs = (end.cpuUs - start.cpuUs) / 1000.0;
+    std::cout << what << ": wall=" << wallMs << "ms, cpu=" << cpuMs << "ms("
+              << (wallMs > 0 ? cpuMs * 100 / wallMs : 0)
+              << "%), context switches voluntary=" << (end.voluntary - start.voluntary)
+              << ", involuntary=" << (end.involuntary - start.involuntary) << std::endl;
+  }
+};
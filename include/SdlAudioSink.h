@@ -0,0 +1,249 @@
+#pragma once
+
+#include "AudioSink.h"
+#include "MediaProcessor.hpp"
+#include "ThreadPolicy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+extern "C" {
+#include "SDL/SDL.h"
+};
+
+
+/*
+ * SDL audio device, kept open across playlist items.
+ * The callback pulls from the current source, which can be switched without reopening
+ * the device when the next item has the same output format.
+ */
+class SdlAudioSink : public AudioSink {
+  static const int FIRST_FRAME_TIMEOUT_MS = 5000;
+  static const int FALLBACK_SAMPLES = 1024;
+
+  SDL_AudioDeviceID audioDeviceID = 0;
+  // what the device accepted, every attached source is converted to it.
+  ffmpegUtil::AudioInfo deviceAudio{};
+  int samples = -1;
+  // audio the source keeps decoded on top of the device buffer.
+  int queueSamples = -1;
+  // 0: device buffer of one decoded frame, one more frame queued.
+  const int latencyMs;
+  std::atomic<AudioProcessor*> source{nullptr};
+  bool paused = false;
+
+  static void callback(void* userdata, Uint8* stream, int len) {
+    ThreadPolicy::shared().applyOnce("lp-audio", ThreadRole::AUDIO);
+    SdlAudioSink* output = (SdlAudioSink*)userdata;
+    AudioProcessor* receiver = output->source.load();
+    if (receiver != nullptr) {
+      receiver->writeAudioData(stream, len);
+    } else {
+      std::memset(stream, 0, len);
+    }
+  }
+
+  bool isCompatible(AudioProcessor& aProcessor) const {
+    // the queue decouples the callback size from the decoded frames, the rate must match.
+    return audioDeviceID != 0 && deviceAudio.sampleRate == aProcessor.getOutSampleRate();
+  }
+
+ public:
+  explicit SdlAudioSink(int latency = 0) : latencyMs(latency) {}
+  SdlAudioSink(const SdlAudioSink&) = delete;
+  SdlAudioSink& operator=(const SdlAudioSink&) = delete;
+
+  ~SdlAudioSink() { close(); }
+
+  const char* getName() const override { return "sdl"; }
+
+  /*
+   * switch to a new source, reopen the device only when the format changed.
+   */
+  void attach(AudioProcessor& aProcessor) override {
+    if (isCompatible(aProcessor)) {
+      aProcessor.setOutputAudio(deviceAudio, samples, queueSamples);
+      // make sure the callback is not running while switching.
+      SDL_LockAudioDevice(audioDeviceID);
+      source.store(&aProcessor);
+      SDL_UnlockAudioDevice(audioDeviceID);
+      cout << "SdlAudioSink: reuse audio device." << endl;
+    } else {
+      close();
+      // the device buffer is sized from the decoded frames.
+      int frameSamples = latencyMs <= 0 ? waitSamples(aProcessor) : 0;
+      source.store(&aProcessor);
+      open(aProcessor, frameSamples);
+    }
+  }
+
+  void detach() override {
+    if (audioDeviceID != 0) {
+      SDL_LockAudioDevice(audioDeviceID);
+      source.store(nullptr);
+      SDL_UnlockAudioDevice(audioDeviceID);
+    } else {
+      source.store(nullptr);
+    }
+  }
+
+  void setPaused(bool p) override {
+    paused = p;
+    if (audioDeviceID != 0) {
+      SDL_PauseAudioDevice(audioDeviceID, paused ? 1 : 0);
+    }
+  }
+
+  void close() override {
+    if (audioDeviceID != 0) {
+      SDL_PauseAudioDevice(audioDeviceID, 1);
+      SDL_CloseAudioDevice(audioDeviceID);
+      audioDeviceID = 0;
+    }
+  }
+
+  /*
+   * start of the data handed to SDL by the last callback.
+   */
+  uint64_t getClockMs() override {
+    AudioProcessor* receiver = source.load();
+    return receiver != nullptr ? receiver->getPts() : 0;
+  }
+
+ private:
+  /*
+   * power of two device buffer of about half the latency target.
+   */
+  int deviceSamplesFor(int freq) const {
+    int64_t wanted = (int64_t)freq * latencyMs / 2000;
+    int deviceSamples = 64;
+    while (deviceSamples * 2 <= wanted && deviceSamples < 8192) {
+      deviceSamples *= 2;
+    }
+    return deviceSamples;
+  }
+
+  static SDL_AudioFormat toSdlFormat(AVSampleFormat format) {
+    switch (format) {
+      case AV_SAMPLE_FMT_S32:
+        return AUDIO_S32SYS;
+      case AV_SAMPLE_FMT_FLT:
+        return AUDIO_F32SYS;
+      default:
+        return AUDIO_S16SYS;
+    }
+  }
+
+  static bool toSampleFormat(SDL_AudioFormat sdlFormat, AVSampleFormat& format) {
+    switch (sdlFormat) {
+      case AUDIO_S16SYS:
+        format = AV_SAMPLE_FMT_S16;
+        return true;
+      case AUDIO_S32SYS:
+        format = AV_SAMPLE_FMT_S32;
+        return true;
+      case AUDIO_F32SYS:
+        format = AV_SAMPLE_FMT_FLT;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /*
+   * samples of the first decoded frame, the decoder wakes us up when it is there.
+   */
+  static int waitSamples(AudioProcessor& aProcessor) {
+    int frameSamples = aProcessor.waitFirstFrame(FIRST_FRAME_TIMEOUT_MS);
+    if (frameSamples <= 0) {
+      cout << "WARN: no audio frame decoded, device buffer of " << FALLBACK_SAMPLES
+           << " samples." << endl;
+      return FALLBACK_SAMPLES;
+    }
+    cout << "get audio samples:" << frameSamples << endl;
+    return frameSamples;
+  }
+
+  void open(AudioProcessor& aProcessor, int frameSamples) {
+    //--------------------- GET SDL audio READY -------------------
+
+    // audio specs containers
+    SDL_AudioSpec wanted_specs;
+    SDL_AudioSpec specs;
+
+    cout << "aProcessor.getSampleFormat() = " << aProcessor.getSampleFormat() << endl;
+    cout << "aProcessor.getSampleRate() = " << aProcessor.getOutSampleRate() << endl;
+    cout << "aProcessor.getChannels() = " << aProcessor.getOutChannels() << endl;
+    cout << "++" << endl;
+
+    // set audio settings from codec info
+    wanted_specs.freq = aProcessor.getOutSampleRate();
+    wanted_specs.format = toSdlFormat(aProcessor.getOutputAudio().format);
+    wanted_specs.channels = aProcessor.getOutChannels();
+    wanted_specs.samples =
+        latencyMs > 0 ? deviceSamplesFor(wanted_specs.freq) : frameSamples;
+    wanted_specs.callback = callback;
+    wanted_specs.userdata = this;
+
+    // open audio device, the device may pick its own format and channels, the rate is
+    // kept so that the callback size still matches the decoded frames.
+    audioDeviceID =
+        SDL_OpenAudioDevice(nullptr, 0, &wanted_specs, &specs,
+                            SDL_AUDIO_ALLOW_FORMAT_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+    AVSampleFormat deviceFormat;
+    if (audioDeviceID != 0 && !toSampleFormat(specs.format, deviceFormat)) {
+      // a format we do not produce, let SDL convert from float.
+      SDL_CloseAudioDevice(audioDeviceID);
+      wanted_specs.format = AUDIO_F32SYS;
+      wanted_specs.channels = specs.channels;
+      audioDeviceID = SDL_OpenAudioDevice(nullptr, 0, &wanted_specs, &specs, 0);
+      deviceFormat = AV_SAMPLE_FMT_FLT;
+    }
+
+    // SDL_OpenAudioDevice returns a valid device ID that is > 0 on success or 0 on failure
+    if (audioDeviceID == 0) {
+      string errMsg = "Failed to open audio device:";
+      errMsg += SDL_GetError();
+      cout << errMsg << endl;
+      throw std::runtime_error(errMsg);
+    }
+
+    int64_t layout = specs.channels == aProcessor.getOutChannels()
+                         ? aProcessor.getOutputAudio().layout
+                         : av_get_default_channel_layout(specs.channels);
+    deviceAudio = ffmpegUtil::AudioInfo(layout, specs.freq, specs.channels, deviceFormat);
+    samples = specs.samples;
+    if (latencyMs > 0) {
+      // the device buffer takes about half of the target, the queue the rest.
+      queueSamples = std::max((int)((int64_t)specs.freq * latencyMs / 1000) - samples, samples);
+    } else {
+      queueSamples = samples;
+    }
+    cout << "audio latency: target=" << latencyMs << "ms, device buffer="
+         << (samples * 1000.0 / specs.freq) << "ms, queue=" << (queueSamples * 1000.0 / specs.freq)
+         << "ms" << endl;
+    // before unpausing, the first callback gets data in the device format.
+    aProcessor.setOutputAudio(deviceAudio, samples, queueSamples);
+
+    cout << "wanted_specs.freq:" << wanted_specs.freq << endl;
+    // cout << "wanted_specs.format:" << wanted_specs.format << endl;
+    std::printf("wanted_specs.format: Ox%X\n", wanted_specs.format);
+    cout << "wanted_specs.channels:" << (int)wanted_specs.channels << endl;
+    cout << "wanted_specs.samples:" << (int)wanted_specs.samples << endl;
+
+    cout << "------------------------------------------------" << endl;
+
+    cout << "specs.freq:" << specs.freq << endl;
+    // cout << "specs.format:" << specs.format << endl;
+    std::printf("specs.format: Ox%X\n", specs.format);
+    cout << "specs.channels:" << (int)specs.channels << endl;
+    cout << "specs.silence:" << (int)specs.silence << endl;
+    cout << "specs.samples:" << (int)specs.samples << endl;
+
+    SDL_PauseAudioDevice(audioDeviceID, paused ? 1 : 0);
+    cout << "[THREAD] audio start thread finish." << endl;
+  }
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+
+#include <deque>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ffmpegUtil {
+
+/*
+ * Numbered local segment files played as one continuous timeline.
+ *
+ * Manifest('*.seglist'), one segment path per line, relative paths are relative to the
+ * manifest, empty lines and lines starting with '#' are ignored:
+ *
+ *   # recording 2020-05-13
+ *   rec_0000.ts
+ *   rec_0001.ts
+ *
+ * All segments are expected to carry the same codecs as the first one, decoders are created
+ * from the first segment only. Packets of every segment are rebased onto the timeline of the
+ * first segment, so pts keep growing across segment boundaries.
+ * The next segments are opened(and probed) concurrently ahead of time, crossing a boundary
+ * only takes a segment which is already opened.
+ */
+class SegmentedPacketGrabber : public PacketSource {
+  std::vector<string> segmentUrls{};
+  const int prefetchCount;
+
+  // the first segment, also the source of getFormatCtx() for the decoders.
+  std::unique_ptr<PacketGrabber> head{};
+  std::unique_ptr<PacketGrabber> currentOwned{};
+  PacketGrabber* current = nullptr;
+
+  size_t currentSegment = 0;
+  size_t nextPrefetchSegment = 1;
+  std::deque<std::future<std::unique_ptr<PacketGrabber>>> prefetched{};
+
+  // timeline offset of the current segment, in AV_TIME_BASE.
+  int64_t segmentOffsetUs = 0;
+  int64_t segmentStartUs = 0;
+  int64_t segmentLengthUs = 0;
+  int64_t headStartUs = 0;
+
+  bool fileGotToEnd = false;
+
+  static int64_t startTimeUs(AVFormatContext* f) {
+    return f->start_time != AV_NOPTS_VALUE ? f->start_time : 0;
+  }
+
+  static std::unique_ptr<PacketGrabber> openSegment(string url) {
+    return std::unique_ptr<PacketGrabber>(new PacketGrabber(url));
+  }
+
+  void prefetch() {
+    while ((int)prefetched.size() < prefetchCount &&
+           nextPrefetchSegment < segmentUrls.size()) {
+      prefetched.push_back(std::async(std::launch::async, openSegment,
+                                      segmentUrls[nextPrefetchSegment]));
+      nextPrefetchSegment++;
+    }
+  }
+
+  bool openNextSegment() {
+    // length of a segment is measured from its packets, fall back to the container duration.
+    if (segmentLengthUs <= 0 && current->getFormatCtx()->duration > 0) {
+      segmentLengthUs = current->getFormatCtx()->duration;
+    }
+    segmentOffsetUs += segmentLengthUs;
+
+    while (!prefetched.empty()) {
+      auto f = std::move(prefetched.front());
+      prefetched.pop_front();
+      currentSegment++;
+      prefetch();
+      try {
+        currentOwned = f.get();
+      } catch (std::exception& e) {
+        cout << "WARN: skip segment [" << currentSegment << "]: " << e.what() << endl;
+        continue;
+      }
+      current = currentOwned.get();
+      segmentStartUs = startTimeUs(current->getFormatCtx());
+      segmentLengthUs = 0;
+      cout << "segment [" << currentSegment << "] started, offset=" << segmentOffsetUs / 1000
+           << "ms" << endl;
+      return true;
+    }
+    return false;
+  }
+
+  /*
+   * stream index of the current segment => stream index of the head segment.
+   */
+  int mapStream(int index) const {
+    if (index == current->getAudioIndex()) {
+      return head->getAudioIndex();
+    } else if (index == current->getVideoIndex()) {
+      return head->getVideoIndex();
+    } else {
+      return -1;
+    }
+  }
+
+  int64_t rebase(int64_t ts, AVRational inTb, AVRational outTb) const {
+    if (ts == AV_NOPTS_VALUE) {
+      return ts;
+    }
+    const AVRational usTb{1, AV_TIME_BASE};
+    int64_t us = av_rescale_q(ts, inTb, usTb) - segmentStartUs + segmentOffsetUs + headStartUs;
+    return av_rescale_q(us, usTb, outTb);
+  }
+
+ public:
+  SegmentedPacketGrabber(const SegmentedPacketGrabber&) = delete;
+  SegmentedPacketGrabber& operator=(const SegmentedPacketGrabber&) = delete;
+
+  SegmentedPacketGrabber(const string& manifestPath, int prefetch = 2)
+      : segmentUrls(readManifest(manifestPath)), prefetchCount(prefetch < 1 ? 1 : prefetch) {
+    if (segmentUrls.empty()) {
+      string errorMsg = "No segment in manifest:";
+      errorMsg += manifestPath;
+      cout << errorMsg << endl;
+      throw std::runtime_error(errorMsg);
+    }
+
+    // start opening the following segments while the first one is probed.
+    this->prefetch();
+    head = openSegment(segmentUrls[0]);
+    current = head.get();
+    headStartUs = startTimeUs(head->getFormatCtx());
+    segmentStartUs = headStartUs;
+    cout << "SegmentedPacketGrabber: " << segmentUrls.size() << " segments, prefetch "
+         << prefetchCount << endl;
+  }
+
+  ~SegmentedPacketGrabber() {
+    // wait for the opening segments, they are freed with their futures.
+    for (auto& f : prefetched) {
+      if (f.valid()) f.wait();
+    }
+  }
+
+  static bool isManifest(const string& path) {
+    const string ext = ".seglist";
+    return path.size() > ext.size() &&
+           path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+  }
+
+  static std::vector<string> readManifest(const string& manifestPath) {
+    std::ifstream is{manifestPath};
+    if (!is) {
+      string errorMsg = "Can not open manifest:";
+      errorMsg += manifestPath;
+      cout << errorMsg << endl;
+      throw std::runtime_error(errorMsg);
+    }
+
+    string dir{};
+    auto slash = manifestPath.find_last_of("/\\");
+    if (slash != string::npos) {
+      dir = manifestPath.substr(0, slash + 1);
+    }
+
+    std::vector<string> urls{};
+    string line;
+    while (std::getline(is, line)) {
+      // trim, manifests written on windows end with '\r'.
+      line.erase(0, line.find_first_not_of(" \t"));
+      line.erase(line.find_last_not_of(" \t\r") + 1);
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      bool absolute = line[0] == '/' || line[0] == '\\' ||
+                      (line.size() > 1 && line[1] == ':') || line.find("://") != string::npos;
+      urls.push_back(absolute ? line : dir + line);
+    }
+    return urls;
+  }
+
+  int grabPacket(AVPacket* pkt) override {
+    while (!fileGotToEnd) {
+      int t = current->grabPacket(pkt);
+      if (t < 0) {
+        if (!openNextSegment()) {
+          fileGotToEnd = true;
+        }
+        continue;
+      }
+
+      int outIndex = mapStream(t);
+      if (outIndex < 0) {
+        av_packet_unref(pkt);
+        continue;
+      }
+
+      auto inTb = current->getFormatCtx()->streams[t]->time_base;
+      auto outTb = head->getFormatCtx()->streams[outIndex]->time_base;
+
+      int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+      if (ts != AV_NOPTS_VALUE) {
+        const AVRational usTb{1, AV_TIME_BASE};
+        int64_t endUs = av_rescale_q(ts + pkt->duration, inTb, usTb) - segmentStartUs;
+        if (endUs > segmentLengthUs) {
+          segmentLengthUs = endUs;
+        }
+      }
+
+      pkt->pts = rebase(pkt->pts, inTb, outTb);
+      pkt->dts = rebase(pkt->dts, inTb, outTb);
+      pkt->duration = av_rescale_q(pkt->duration, inTb, outTb);
+      // byte positions are meaningless across files.
+      pkt->pos = -1;
+      pkt->stream_index = outIndex;
+      return outIndex;
+    }
+    return -1;
+  }
+
+  AVFormatContext* getFormatCtx() const override { return head->getFormatCtx(); }
+
+  bool isFileEnd() const override { return fileGotToEnd; }
+
+  int getAudioIndex() const override { return head->getAudioIndex(); }
+  int getVideoIndex() const override { return head->getVideoIndex(); }
+
+  size_t getSegmentCount() const { return segmentUrls.size(); }
+  size_t getCurrentSegment() const { return currentSegment; }
+};
+
+}  // namespace ffmpegUtil
@@ -0,0 +1,14 @@
+#pragma once
+
+// compile time simd selection of the audio kernels: AVX2(-mavx2), SSE2, NEON, or scalar.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LP_SIMD_SSE2 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LP_SIMD_NEON 1
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/*
+ * stop and pause requests for a thread that sleeps between its rounds.
+ * waitFor wakes up at once on stop(), so the owner can join right away
+ * instead of waiting out a sleep. While paused, waitFor parks the thread without any
+ * timeout until it is resumed or stopped.
+ */
+class StopSignal {
+  std::mutex mtx{};
+  std::condition_variable cv{};
+  bool stopped = false;
+  bool paused = false;
+
+ public:
+  StopSignal() = default;
+  StopSignal(const StopSignal&) = delete;
+  StopSignal& operator=(const StopSignal&) = delete;
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lk{mtx};
+      stopped = true;
+    }
+    cv.notify_all();
+  }
+
+  void setPaused(bool p) {
+    {
+      std::lock_guard<std::mutex> lk{mtx};
+      paused = p;
+    }
+    cv.notify_all();
+  }
+
+  // for a restart of the thread.
+  void reset() {
+    std::lock_guard<std::mutex> lk{mtx};
+    stopped = false;
+  }
+
+  bool isStopped() {
+    std::lock_guard<std::mutex> lk{mtx};
+    return stopped;
+  }
+
+  /*
+   * sleep up to ms, after waiting out a pause.
+   *  return
+   *          true   : stop was requested
+   */
+  bool waitFor(int ms) {
+    std::unique_lock<std::mutex> lk{mtx};
+    cv.wait(lk, [this] { return stopped || !paused; });
+    return cv.wait_for(lk, std::chrono::milliseconds(ms), [this] { return stopped; });
+  }
+};
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "ThreadPolicy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work-stealing pool shared by every player of the process, one thread per core.
+ *
+ * Each worker has its own deque: a task submitted from a worker goes to the back of that
+ * worker's deque and is taken from the back again(LIFO, the data is still in its cache),
+ * an idle worker steals from the front of the others. Tasks from other threads are dealt
+ * round robin. Tasks must not block on each other, except by parallelFor, which runs
+ * the items itself while it waits.
+ *
+ * Cooperative, it has no workers at all: the tasks are run by the one thread that owns
+ * the executor, calling runNext in its loop, earliest deadline first. For hosts with a
+ * core or two, where switching between the threads costs more than they bring.
+ */
+class TaskExecutor {
+ public:
+  using Task = std::function<void()>;
+
+  // threadCount of an executor without workers.
+  static const int COOPERATIVE = -1;
+
+  struct TimedTask {
+    int64_t deadlineMs;
+    Task task;
+  };
+
+ private:
+  struct WorkerQueue {
+    std::mutex mtx{};
+    std::deque<Task> tasks{};
+  };
+
+  // the executor and queue of the calling thread, if it is a worker.
+  struct WorkerSlot {
+    const TaskExecutor* owner;
+    int index;
+  };
+
+  static WorkerSlot& currentSlot() {
+    static thread_local WorkerSlot slot{nullptr, -1};
+    return slot;
+  }
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues{};
+  std::vector<std::thread> threads{};
+  std::atomic<int> pending{0};
+  std::atomic<unsigned> nextQueue{0};
+  std::atomic<int64_t> stolen{0};
+  std::mutex sleepMutex{};
+  std::condition_variable wake{};
+  bool stopping = false;
+  bool cooperative = false;
+  // cooperative: every task, unordered, guarded by sleepMutex.
+  std::vector<TimedTask> timed{};
+
+  static int& sharedThreadCount() {
+    static int count = 0;
+    return count;
+  }
+
+  bool popLocal(int index, Task& task) {
+    auto& q = *queues[index];
+    std::lock_guard<std::mutex> lk{q.mtx};
+    if (q.tasks.empty()) {
+      return false;
+    }
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    return true;
+  }
+
+  bool steal(int index, Task& task) {
+    int n = (int)queues.size();
+    for (int k = 1; k < n; k++) {
+      auto& q = *queues[(index + k) % n];
+      std::lock_guard<std::mutex> lk{q.mtx};
+      if (!q.tasks.empty()) {
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        stolen++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void workerLoop(int index) {
+    currentSlot() = WorkerSlot{this, index};
+    ThreadPolicy::shared().apply("lp-decode-" + std::to_string(index), ThreadRole::DECODE);
+    while (true) {
+      Task task{};
+      if (popLocal(index, task) || steal(index, task)) {
+        pending--;
+        task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lk{sleepMutex};
+      wake.wait(lk, [this] { return stopping || pending.load() > 0; });
+      if (stopping && pending.load() == 0) {
+        break;
+      }
+    }
+  }
+
+ public:
+  explicit TaskExecutor(int threadCount = 0) {
+    if (threadCount == COOPERATIVE) {
+      cooperative = true;
+      std::cout << "TaskExecutor started, cooperative" << std::endl;
+      return;
+    }
+    if (threadCount <= 0) {
+      threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < threadCount; i++) {
+      queues.emplace_back(new WorkerQueue());
+    }
+    for (int i = 0; i < threadCount; i++) {
+      threads.emplace_back(&TaskExecutor::workerLoop, this, i);
+    }
+    std::cout << "TaskExecutor started, threads=" << threadCount << std::endl;
+  }
+
+  TaskExecutor(const TaskExecutor&) = delete;
+  TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+  // runs what is queued, then stops the workers.
+  ~TaskExecutor() {
+    {
+      std::lock_guard<std::mutex> lk{sleepMutex};
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  // the pool of the process, started on first use.
+  static TaskExecutor& shared() {
+    static TaskExecutor executor{sharedThreadCount()};
+    return executor;
+  }
+
+  // threads of the shared pool, or COOPERATIVE, before it is first used.
+  static void configureShared(int threadCount) { sharedThreadCount() = threadCount; }
+
+  static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  int threadCount() const { return (int)threads.size(); }
+
+  bool isCooperative() const { return cooperative; }
+
+  int64_t getStolenCount() const { return stolen.load(); }
+
+  /*
+   * deadlineMs(see nowMs) is when the result is needed, only a cooperative executor
+   * orders by it.
+   */
+  void submit(Task task, int64_t deadlineMs = 0) {
+    if (cooperative) {
+      std::lock_guard<std::mutex> lk{sleepMutex};
+      timed.push_back(TimedTask{deadlineMs, std::move(task)});
+      return;
+    }
+    auto& slot = currentSlot();
+    int index = slot.owner == this ? slot.index : (int)(nextQueue++ % queues.size());
+    {
+      auto& q = *queues[index];
+      std::lock_guard<std::mutex> lk{q.mtx};
+      q.tasks.push_back(std::move(task));
+    }
+    pending++;
+    {
+      // a worker checks pending under this lock before it sleeps.
+      std::lock_guard<std::mutex> lk{sleepMutex};
+    }
+    wake.notify_one();
+  }
+
+  /*
+   * cooperative: run the task with the earliest deadline.
+   *  return
+   *          false  : nothing was queued
+   */
+  bool runNext() {
+    TimedTask next{};
+    {
+      std::lock_guard<std::mutex> lk{sleepMutex};
+      if (timed.empty()) {
+        return false;
+      }
+      auto it = std::min_element(timed.begin(), timed.end(),
+                                 [](const TimedTask& x, const TimedTask& y) {
+                                   return x.deadlineMs < y.deadlineMs;
+                                 });
+      next = std::move(*it);
+      timed.erase(it);
+    }
+    next.task();
+    return true;
+  }
+
+  // cooperative: the earliest deadline queued, INT64_MAX for none.
+  int64_t nextDeadline() {
+    std::lock_guard<std::mutex> lk{sleepMutex};
+    int64_t earliest = INT64_MAX;
+    for (auto& t : timed) {
+      earliest = std::min(earliest, t.deadlineMs);
+    }
+    return earliest;
+  }
+
+  /*
+   * fn(0) .. fn(n - 1) on the pool, returns when all are done.
+   * The calling thread runs items as well, so it may be a worker itself; without
+   * workers it runs them all.
+   */
+  template <typename F>
+  void parallelFor(int n, const F& fn) {
+    if (n <= 1) {
+      if (n == 1) {
+        fn(0);
+      }
+      return;
+    }
+    struct Job {
+      std::atomic<int> next{0};
+      std::atomic<int> done{0};
+      std::mutex mtx{};
+      std::condition_variable cv{};
+    };
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    // a helper starting after the last item only sees next >= n and never touches fn.
+    auto run = [job, n, &fn] {
+      int i;
+      while ((i = job->next++) < n) {
+        fn(i);
+        if (++job->done == n) {
+          std::lock_guard<std::mutex> lk{job->mtx};
+          job->cv.notify_all();
+        }
+      }
+    };
+    int helpers = std::min(n, threadCount()) - 1;
+    for (int k = 0; k < helpers; k++) {
+      submit(run);
+    }
+    run();
+    std::unique_lock<std::mutex> lk{job->mtx};
+    job->cv.wait(lk, [&job, n] { return job->done.load() == n; });
+  }
+};
+
+/*
+ * Tasks of one stream on the shared executor: they run one at a time, in the order they
+ * were posted, on whichever worker is free. One task is run per executor task, so a
+ * busy stream does not keep a worker from the others.
+ */
+class TaskStrand {
+  TaskExecutor& executor;
+  std::mutex mtx{};
+  std::condition_variable idle{};
+  std::deque<TaskExecutor::TimedTask> tasks{};
+  bool running = false;
+  bool closed = false;
+
+  void runNext() {
+    TaskExecutor::Task task{};
+    {
+      std::lock_guard<std::mutex> lk{mtx};
+      if (tasks.empty()) {
+        running = false;
+        idle.notify_all();
+        return;
+      }
+      task = std::move(tasks.front().task);
+      tasks.pop_front();
+    }
+    task();
+    std::lock_guard<std::mutex> lk{mtx};
+    if (tasks.empty()) {
+      running = false;
+      idle.notify_all();
+    } else {
+      executor.submit([this] { runNext(); }, tasks.front().deadlineMs);
+    }
+  }
+
+ public:
+  explicit TaskStrand(TaskExecutor& e) : executor(e) {}
+  TaskStrand(const TaskStrand&) = delete;
+  TaskStrand& operator=(const TaskStrand&) = delete;
+  ~TaskStrand() { close(); }
+
+  /*
+   *  return
+   *          false  : the strand is closed, the task is dropped
+   */
+  bool post(TaskExecutor::Task task, int64_t deadlineMs = 0) {
+    std::lock_guard<std::mutex> lk{mtx};
+    if (closed) {
+      return false;
+    }
+    tasks.push_back(TaskExecutor::TimedTask{deadlineMs, std::move(task)});
+    if (!running) {
+      running = true;
+      executor.submit([this] { runNext(); }, deadlineMs);
+    }
+    return true;
+  }
+
+  /*
+   * drop the queued tasks and wait for the running one, later posts are dropped.
+   * Must not be called from a task of this strand.
+   */
+  void close() {
+    std::unique_lock<std::mutex> lk{mtx};
+    closed = true;
+    tasks.clear();
+    // nobody else runs the task submitted for this strand, run the queue down here.
+    while (running && executor.isCooperative()) {
+      lk.unlock();
+      bool ran = executor.runNext();
+      lk.lock();
+      if (!ran) {
+        break;
+      }
+    }
+    idle.wait(lk, [this] { return !running; });
+  }
+
+  // accept tasks again after close.
+  void open() {
+    std::lock_guard<std::mutex> lk{mtx};
+    closed = false;
+  }
+};
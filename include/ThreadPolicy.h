@@ -0,0 +1,185 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * What a thread of the player does, the policy is chosen by it.
+ */
+enum class ThreadRole { DECODE, READER, REFRESH, AUDIO, OTHER };
+
+/*
+ * Names every thread of the player, for top -H, perf and debuggers. Optionally the decode
+ * workers are kept on chosen cores, and the threads feeding the audio device get a
+ * real-time priority, so a busy machine does not starve them into underruns.
+ *
+ * Nothing here is required: what the platform or the permissions do not allow is skipped,
+ * reported once, and the thread runs on as before. Each thread applies the policy to
+ * itself when it starts(apply), settings are read at that point.
+ */
+class ThreadPolicy {
+  std::mutex mtx{};
+  std::vector<int> decodeCores{};
+  std::atomic<bool> realtimeAudio{false};
+  std::atomic<bool> realtimeRefused{false};
+
+  // the names are cut to 15 chars by the kernel.
+  static void setName(const std::string& name) {
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+    pthread_setname_np(name.c_str());
+#else
+    (void)name;
+#endif
+  }
+
+  static bool pin(const std::vector<int>& cores) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cores) {
+      if (c < CPU_SETSIZE) {
+        CPU_SET(c, &set);
+      }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (int c : cores) {
+      if (c < (int)sizeof(DWORD_PTR) * 8) {
+        mask |= (DWORD_PTR)1 << c;
+      }
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    (void)cores;
+    return false;
+#endif
+  }
+
+  /*
+   * SCHED_FIFO, else SCHED_RR, else a lower nice value.
+   *  return
+   *          the policy that was set, nullptr when none was allowed.
+   */
+  static const char* raise() {
+#if defined(_WIN32)
+    if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+      return "TIME_CRITICAL";
+    }
+    return nullptr;
+#else
+    const int policies[] = {SCHED_FIFO, SCHED_RR};
+    const char* names[] = {"SCHED_FIFO", "SCHED_RR"};
+    for (int i = 0; i < 2; i++) {
+      // low in the real-time range: above every normal thread, below the system ones.
+      sched_param param{};
+      param.sched_priority = sched_get_priority_min(policies[i]) + 10;
+      if (pthread_setschedparam(pthread_self(), policies[i], &param) == 0) {
+        return names[i];
+      }
+    }
+#if defined(__linux__)
+    // nice is per thread on linux.
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), -10) == 0) {
+      return "nice -10";
+    }
+#endif
+    return nullptr;
+#endif
+  }
+
+ public:
+  ThreadPolicy() = default;
+  ThreadPolicy(const ThreadPolicy&) = delete;
+  ThreadPolicy& operator=(const ThreadPolicy&) = delete;
+
+  static ThreadPolicy& shared() {
+    static ThreadPolicy policy{};
+    return policy;
+  }
+
+  // empty for any core.
+  void setDecodeCores(const std::vector<int>& cores) {
+    std::lock_guard<std::mutex> lk{mtx};
+    decodeCores = cores;
+  }
+
+  void setRealtimeAudio(bool enabled) { realtimeAudio.store(enabled); }
+
+  // "2,3" to {2, 3}, anything else is skipped.
+  static std::vector<int> parseCores(const std::string& list) {
+    std::vector<int> cores{};
+    size_t pos = 0;
+    while (pos < list.size()) {
+      size_t end = list.find(',', pos);
+      if (end == std::string::npos) {
+        end = list.size();
+      }
+      int core = std::atoi(list.substr(pos, end - pos).c_str());
+      if (core >= 0 && end > pos) {
+        cores.push_back(core);
+      }
+      pos = end + 1;
+    }
+    return cores;
+  }
+
+  /*
+   * name the calling thread and apply the policy of its role to it.
+   */
+  void apply(const std::string& name, ThreadRole role) {
+    setName(name);
+    if (role == ThreadRole::DECODE) {
+      std::vector<int> cores{};
+      {
+        std::lock_guard<std::mutex> lk{mtx};
+        cores = decodeCores;
+      }
+      if (!cores.empty() && !pin(cores)) {
+        std::cout << "WARN: thread " << name << " can not be pinned, runs on any core."
+                  << std::endl;
+      }
+    } else if (role == ThreadRole::AUDIO && realtimeAudio.load() &&
+               !realtimeRefused.load()) {
+      const char* policy = raise();
+      if (policy != nullptr) {
+        std::cout << "thread " << name << ": " << policy << std::endl;
+      } else if (!realtimeRefused.exchange(true)) {
+        std::cout << "WARN: no real-time priority allowed for " << name
+                  << ", audio runs at normal priority." << std::endl;
+      }
+    }
+  }
+
+  /*
+   * apply once per thread, for threads that are not ours, e.g. the SDL audio callback.
+   */
+  void applyOnce(const char* name, ThreadRole role) {
+    static thread_local bool applied = false;
+    if (!applied) {
+      applied = true;
+      apply(name, role);
+    }
+  }
+};
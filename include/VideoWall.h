@@ -0,0 +1,177 @@
+#pragma once
+
+#include "ffmpegUtil.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "SDL/SDL.h"
+};
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+ * Where the players of a wall show their frames: one tile per player.
+ * show and present are called from the render thread only.
+ */
+class VideoTarget {
+ public:
+  virtual ~VideoTarget() {}
+
+  // a yuv420p frame of w x h for the tile.
+  virtual void show(int tile, const AVFrame* frame, int w, int h) = 0;
+
+  // after the tiles of one refresh are updated.
+  virtual void present() = 0;
+
+  virtual void printStats() {}
+};
+
+/*
+ * One window, cols x rows tiles, each a texture of the size of its video.
+ * The video is fitted into its tile keeping the aspect ratio.
+ */
+class SdlVideoWall : public VideoTarget {
+  struct Tile {
+    SDL_Texture* texture = nullptr;
+    int width = -1;
+    int height = -1;
+  };
+
+  SDL_Window* screen = nullptr;
+  SDL_Renderer* sdlRenderer = nullptr;
+  std::vector<Tile> tiles{};
+  int cols;
+  int rows;
+
+ public:
+  SdlVideoWall(int tileCount, int columns, int width, int height)
+      : tiles(tileCount), cols(std::max(1, columns)) {
+    rows = (tileCount + cols - 1) / cols;
+    if (!SDL_WasInit(SDL_INIT_VIDEO) && SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+      string errMsg = "Could not initialize SDL video -";
+      errMsg += SDL_GetError();
+      cout << errMsg << endl;
+      throw std::runtime_error(errMsg);
+    }
+    screen = SDL_CreateWindow("Little Player Wall", SDL_WINDOWPOS_UNDEFINED,
+                              SDL_WINDOWPOS_UNDEFINED, width, height,
+                              SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+    if (!screen) {
+      string errMsg = "SDL: could not create window - exiting:";
+      errMsg += SDL_GetError();
+      cout << errMsg << endl;
+      throw std::runtime_error(errMsg);
+    }
+    sdlRenderer = SDL_CreateRenderer(screen, -1, 0);
+    cout << "SdlVideoWall: " << cols << "x" << rows << " tiles" << endl;
+  }
+
+  SdlVideoWall(const SdlVideoWall&) = delete;
+  SdlVideoWall& operator=(const SdlVideoWall&) = delete;
+
+  ~SdlVideoWall() {
+    for (auto& t : tiles) {
+      if (t.texture != nullptr) SDL_DestroyTexture(t.texture);
+    }
+    if (sdlRenderer != nullptr) SDL_DestroyRenderer(sdlRenderer);
+    if (screen != nullptr) SDL_DestroyWindow(screen);
+  }
+
+  void show(int tile, const AVFrame* frame, int w, int h) override {
+    auto& t = tiles[tile];
+    if (t.texture == nullptr || t.width != w || t.height != h) {
+      if (t.texture != nullptr) {
+        SDL_DestroyTexture(t.texture);
+      }
+      t.texture = SDL_CreateTexture(sdlRenderer, SDL_PIXELFORMAT_IYUV,
+                                    SDL_TEXTUREACCESS_STREAMING, w, h);
+      t.width = w;
+      t.height = h;
+    }
+    SDL_UpdateYUVTexture(t.texture, NULL, frame->data[0], frame->linesize[0], frame->data[1],
+                         frame->linesize[1], frame->data[2], frame->linesize[2]);
+  }
+
+  void present() override {
+    int winW, winH;
+    SDL_GetWindowSize(screen, &winW, &winH);
+    int cellW = winW / cols;
+    int cellH = winH / rows;
+    SDL_RenderClear(sdlRenderer);
+    for (size_t i = 0; i < tiles.size(); i++) {
+      auto& t = tiles[i];
+      if (t.texture == nullptr) {
+        continue;
+      }
+      // fit into the cell, keep the aspect ratio.
+      double scale = std::min((double)cellW / t.width, (double)cellH / t.height);
+      SDL_Rect dst;
+      dst.w = (int)(t.width * scale);
+      dst.h = (int)(t.height * scale);
+      dst.x = (int)(i % cols) * cellW + (cellW - dst.w) / 2;
+      dst.y = (int)(i / cols) * cellH + (cellH - dst.h) / 2;
+      SDL_RenderCopy(sdlRenderer, t.texture, NULL, &dst);
+    }
+    SDL_RenderPresent(sdlRenderer);
+  }
+};
+
+/*
+ * No display: the last frame of every tile is kept in memory, e.g. for a headless
+ * monitor that samples the pictures, or for measuring how many streams one host decodes.
+ */
+class OffscreenVideoWall : public VideoTarget {
+  struct Tile {
+    AVFrame* frame = nullptr;
+    int64_t frames = 0;
+  };
+  std::vector<Tile> tiles{};
+
+ public:
+  explicit OffscreenVideoWall(int tileCount) : tiles(tileCount) {}
+  OffscreenVideoWall(const OffscreenVideoWall&) = delete;
+  OffscreenVideoWall& operator=(const OffscreenVideoWall&) = delete;
+
+  ~OffscreenVideoWall() {
+    for (auto& t : tiles) {
+      av_frame_free(&t.frame);
+    }
+  }
+
+  void show(int tile, const AVFrame* frame, int w, int h) override {
+    auto& t = tiles[tile];
+    if (t.frame == nullptr || t.frame->width != w || t.frame->height != h) {
+      av_frame_free(&t.frame);
+      t.frame = av_frame_alloc();
+      t.frame->format = AV_PIX_FMT_YUV420P;
+      t.frame->width = w;
+      t.frame->height = h;
+      if (av_frame_get_buffer(t.frame, 32) < 0) {
+        throw std::runtime_error("OffscreenVideoWall: av_frame_get_buffer failed.");
+      }
+    }
+    av_image_copy(t.frame->data, t.frame->linesize, (const uint8_t**)frame->data,
+                  frame->linesize, AV_PIX_FMT_YUV420P, w, h);
+    t.frames++;
+  }
+
+  void present() override {}
+
+  // the last frame shown in a tile, nullptr before the first one.
+  const AVFrame* getFrame(int tile) const { return tiles[tile].frame; }
+
+  void printStats() override {
+    cout << "offscreen wall frames:";
+    for (auto& t : tiles) {
+      cout << " " << t.frames;
+    }
+    cout << endl;
+  }
+};
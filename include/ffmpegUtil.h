@@ -29,10 +29,16 @@ extern "C" {
 #endif
 #endif
 
+#include "DownmixMatrix.h"
+#include "Logger.h"
+
+#include <algorithm>
 #include <string>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <tuple>
+#include <vector>
 
 namespace ffmpegUtil {
 
@@ -86,7 +92,30 @@ struct ffUtils {
   }
 };
 
-class PacketGrabber {
+/*
+ * Where the demuxed packets come from, a single file or a list of segments.
+ */
+class PacketSource {
+ public:
+  virtual ~PacketSource() {}
+
+  /*
+   *  return
+   *          x > 0  : stream_index
+   *          -1     : no more pkt
+   */
+  virtual int grabPacket(AVPacket* pkt) = 0;
+
+  // format context of the streams that packets are delivered for.
+  virtual AVFormatContext* getFormatCtx() const = 0;
+
+  virtual bool isFileEnd() const = 0;
+
+  virtual int getAudioIndex() const = 0;
+  virtual int getVideoIndex() const = 0;
+};
+
+class PacketGrabber : public PacketSource {
   const string inputUrl;
   AVFormatContext* formatCtx = nullptr;
   bool fileGotToEnd = false;
@@ -97,8 +126,8 @@ class PacketGrabber {
  public:
   ~PacketGrabber() { 
     if (formatCtx != nullptr) {
-      avformat_free_context(formatCtx);
-      formatCtx = nullptr;
+      // close the input as well, or the file handle is leaked.
+      avformat_close_input(&formatCtx);
     }
     cout << "~PacketGrabber called." << endl; 
   }
@@ -138,7 +167,7 @@ class PacketGrabber {
    *          x > 0  : stream_index
    *          -1     : no more pkt
    */
-  int grabPacket(AVPacket* pkt) {
+  int grabPacket(AVPacket* pkt) override {
     if (fileGotToEnd) {
       return -1;
     }
@@ -153,12 +182,45 @@ class PacketGrabber {
     }
   }
 
-  AVFormatContext* getFormatCtx() const { return formatCtx; }
+  /*
+   * seek to the keyframe at or before the timestamp(in stream time base) of target stream.
+   */
+  bool seekToTimestamp(int streamIndex, int64_t timestamp) {
+    if (av_seek_frame(formatCtx, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+      cout << "WARN: seekToTimestamp failed, timestamp=" << timestamp << endl;
+      return false;
+    }
+    fileGotToEnd = false;
+    return true;
+  }
+
+  /*
+   * seek directly to a byte position, the position must be the start of a packet.
+   */
+  bool seekToByte(int64_t pos) {
+    if (!canSeekByte()) {
+      return false;
+    }
+    if (av_seek_frame(formatCtx, -1, pos, AVSEEK_FLAG_BYTE) < 0) {
+      cout << "WARN: seekToByte failed, pos=" << pos << endl;
+      return false;
+    }
+    fileGotToEnd = false;
+    return true;
+  }
+
+  bool canSeekByte() const {
+    return formatCtx->iformat != nullptr && !(formatCtx->iformat->flags & AVFMT_NO_BYTE_SEEK);
+  }
+
+  const string& getInputUrl() const { return inputUrl; }
+
+  AVFormatContext* getFormatCtx() const override { return formatCtx; }
 
-  bool isFileEnd() const { return fileGotToEnd; }
+  bool isFileEnd() const override { return fileGotToEnd; }
 
-  int getAudioIndex() const { return audioIndex; }
-  int getVideoIndex() const { return videoIndex; }
+  int getAudioIndex() const override { return audioIndex; }
+  int getVideoIndex() const override { return videoIndex; }
 };
 
 
@@ -180,7 +242,11 @@ struct AudioInfo {
 };
 
 class ReSampler {
-  SwrContext* swr;
+  SwrContext* swr = nullptr;
+  std::shared_ptr<const DownmixMatrix> matrix{};
+  // planar float in, float out at the same rate: the downmix kernel does all the work.
+  bool directMix = false;
+  std::vector<float> mixCoeffs{};
 
  public:
   ReSampler(const ReSampler&) = delete;
@@ -205,72 +271,146 @@ class ReSampler {
     return ffmpegUtil::AudioInfo(layout, sampleRate, channels, format);
   }
 
-  ReSampler(AudioInfo input, AudioInfo output) : in(input), out(output) {
+  /*
+   * closest interleaved output to the decoder's format, keeps the channels and the rate.
+   * Only formats an audio device usually takes are produced: S16, S32 and FLT.
+   */
+  static AudioInfo getNativeAudioInfo(const AudioInfo& input) {
+    AVSampleFormat format;
+    switch (av_get_packed_sample_fmt(input.format)) {
+      case AV_SAMPLE_FMT_S32:
+      case AV_SAMPLE_FMT_S64:
+        format = AV_SAMPLE_FMT_S32;
+        break;
+      case AV_SAMPLE_FMT_FLT:
+      case AV_SAMPLE_FMT_DBL:
+        format = AV_SAMPLE_FMT_FLT;
+        break;
+      default:
+        format = AV_SAMPLE_FMT_S16;
+        break;
+    }
+    int64_t layout =
+        input.layout > 0 ? input.layout : av_get_default_channel_layout(input.channels);
+    return ffmpegUtil::AudioInfo(layout, input.sampleRate, input.channels, format);
+  }
+
+  /*
+   * same samples in and out, a plain copy is enough.
+   */
+  static bool isPassthrough(const AudioInfo& input, const AudioInfo& output) {
+    return input.format == output.format && input.sampleRate == output.sampleRate &&
+           input.channels == output.channels &&
+           (input.layout <= 0 || input.layout == output.layout);
+  }
+
+  /*
+   * downmix: the matrix for in.layout to out.layout, nullptr for swr's own downmix.
+   * useKernel: false always mixes in swr, for comparing.
+   */
+  ReSampler(AudioInfo input, AudioInfo output,
+            std::shared_ptr<const DownmixMatrix> downmix = nullptr, bool useKernel = true)
+      : in(input), out(output) {
+    matrix = downmix;
+    directMix = useKernel && matrix != nullptr && in.format == AV_SAMPLE_FMT_FLTP &&
+                out.format == AV_SAMPLE_FMT_FLT && in.sampleRate == out.sampleRate &&
+                in.channels <= DownmixKernels::MAX_IN && matrix->inChannels == in.channels &&
+                matrix->outChannels == out.channels;
+    if (directMix) {
+      mixCoeffs.assign(matrix->coeffs.begin(), matrix->coeffs.end());
+      return;
+    }
+
     swr = swr_alloc_set_opts(nullptr, out.layout, out.format, out.sampleRate, in.layout,
                              in.format, in.sampleRate, 0, nullptr);
 
+    // between alloc and init, swr then uses the matrix instead of building its own.
+    if (matrix != nullptr && swr_set_matrix(swr, matrix->coeffs.data(), matrix->inChannels)) {
+      // no destructor runs for a constructor that throws.
+      swr_free(&swr);
+      throw std::runtime_error("swr_set_matrix error, mode=" + matrix->mode);
+    }
+
     if (swr_init(swr)) {
+      swr_free(&swr);
       throw std::runtime_error("swr_init error.");
     }
   }
 
-  int allocDataBuf(uint8_t** outData, int inputSamples) {
-    int bytePerOutSample = -1;
-    switch (out.format) {
-      case AV_SAMPLE_FMT_U8:
-        bytePerOutSample = 1;
-        break;
-      case AV_SAMPLE_FMT_S16P:
-      case AV_SAMPLE_FMT_S16:
-        bytePerOutSample = 2;
-        break;
-      case AV_SAMPLE_FMT_S32:
-      case AV_SAMPLE_FMT_S32P:
-      case AV_SAMPLE_FMT_FLT:
-      case AV_SAMPLE_FMT_FLTP:
-        bytePerOutSample = 4;
-        break;
-      case AV_SAMPLE_FMT_DBL:
-      case AV_SAMPLE_FMT_DBLP:
-      case AV_SAMPLE_FMT_S64:
-      case AV_SAMPLE_FMT_S64P:
-        bytePerOutSample = 8;
-        break;
-      default:
-        bytePerOutSample = 2;
-        break;
+  /*
+   * which way the channels are mixed, for the logs.
+   */
+  string describeDownmix() const {
+    if (matrix == nullptr) {
+      return in.channels > out.channels ? "swr" : "none";
     }
+    return matrix->mode + (directMix ? "(kernel)" : "(swr matrix)");
+  }
 
-    int guessOutSamplesPerChannel =
-        av_rescale_rnd(inputSamples, out.sampleRate, in.sampleRate, AV_ROUND_UP);
-    int guessOutSize = guessOutSamplesPerChannel * out.channels * bytePerOutSample;
-
-    std::cout << "GuessOutSamplesPerChannel: " << guessOutSamplesPerChannel << std::endl;
-    std::cout << "GuessOutSize: " << guessOutSize << std::endl;
+  /*
+   * bytes needed to convert inputSamples, including what swr still buffers.
+   */
+  int getOutBufferSize(int inputSamples) {
+    int outSamples = directMix ? inputSamples : swr_get_out_samples(swr, inputSamples);
+    if (outSamples <= 0) {
+      outSamples = (int)av_rescale_rnd(inputSamples, out.sampleRate, in.sampleRate,
+                                       AV_ROUND_UP);
+    }
+    return av_samples_get_buffer_size(nullptr, out.channels, outSamples, out.format, 1);
+  }
 
-    guessOutSize *= 1.2;  // just make sure.
+  /*
+   * make sure *outData can take the output of inputSamples, only grows the buffer.
+   *  return
+   *          the buffer size in bytes, bufferSize if nothing changed.
+   */
+  int ensureDataBuf(uint8_t** outData, int bufferSize, int inputSamples) {
+    int needed = getOutBufferSize(inputSamples);
+    if (*outData != nullptr && needed <= bufferSize) {
+      return bufferSize;
+    }
+    if (*outData != nullptr) {
+      av_freep(outData);
+    }
+    *outData = (uint8_t*)av_malloc(needed);
+    if (*outData == nullptr) {
+      throw std::runtime_error("ReSampler: alloc data buffer failed.");
+    }
+    LOGI("ReSampler data buffer: %d bytes for %d input samples.", needed, inputSamples);
+    return needed;
+  }
 
-    *outData = (uint8_t*)av_malloc(sizeof(uint8_t) * guessOutSize);
-    // av_samples_alloc(&outData, NULL, outChannels, guessOutSamplesPerChannel,
-    // AV_SAMPLE_FMT_S16, 0);
-    return guessOutSize;
+  int allocDataBuf(uint8_t** outData, int inputSamples) {
+    *outData = nullptr;
+    return ensureDataBuf(outData, 0, inputSamples);
   }
 
+  /*
+   * dataBufferSize is the buffer size in bytes, see ensureDataBuf.
+   */
   std::tuple<int, int> reSample(uint8_t* dataBuffer, int dataBufferSize,
                                 const AVFrame* frame) {
-    int outSamples = swr_convert(swr, &dataBuffer, dataBufferSize,
+    // swr_convert takes the capacity in samples per channel.
+    int capacity = dataBufferSize / (out.channels * av_get_bytes_per_sample(out.format));
+    if (directMix) {
+      int frames = std::min(frame->nb_samples, capacity);
+      DownmixKernels::mix((const float* const*)frame->extended_data, in.channels, frames,
+                          (float*)dataBuffer, out.channels, mixCoeffs.data());
+      return std::tuple<int, int>{frames, frames * out.channels * (int)sizeof(float)};
+    }
+    int outSamples = swr_convert(swr, &dataBuffer, capacity,
                                  (const uint8_t**)&frame->data[0], frame->nb_samples);
     // cout << "reSample: nb_samples=" << frame->nb_samples << ", sample_rate = " <<
     // frame->sample_rate <<  ", outSamples=" << outSamples << endl;
     if (outSamples <= 0) {
-      throw std::runtime_error("error: outSamples=" + outSamples);
+      throw std::runtime_error("error: outSamples=" + std::to_string(outSamples));
     }
 
     int outDataSize =
         av_samples_get_buffer_size(NULL, out.channels, outSamples, out.format, 1);
 
     if (outDataSize <= 0) {
-      throw std::runtime_error("error: outDataSize=" + outDataSize);
+      throw std::runtime_error("error: outDataSize=" + std::to_string(outDataSize));
     }
 
     return {outSamples, outDataSize};
@@ -29,6 +29,8 @@ extern "C" {
 #include <sstream>
 #include <tuple>
 
+#include "KeyframeIndex.h"
+
 namespace ffmpegUtil {
 
 class FrameGrabber {
@@ -255,6 +257,34 @@ class FrameGrabber {
     }
   }
 
+  int64_t getDurationMs() const {
+    if (formatCtx != nullptr && formatCtx->duration != AV_NOPTS_VALUE) {
+      return formatCtx->duration / (AV_TIME_BASE / 1000);
+    } else {
+      return -1;
+    }
+  }
+
+  AVRational getVideoTimeBase() const {
+    if (formatCtx != nullptr && videoIndex >= 0) {
+      return formatCtx->streams[videoIndex]->time_base;
+    } else {
+      throw std::runtime_error("can not getVideoTimeBase.");
+    }
+  }
+
+  /*
+   * Only decode keyframes(AVDISCARD_NONKEY), everything else is dropped by the decoder
+   * before any decoding work. Must be called after start().
+   */
+  void setKeyframeOnly(bool keyframeOnly) {
+    if (vCodecCtx != nullptr) {
+      vCodecCtx->skip_frame = keyframeOnly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+    } else {
+      throw std::runtime_error("can not setKeyframeOnly.");
+    }
+  }
+
   int getChannels() const {
     if (aCodecCtx != nullptr) {
       return aCodecCtx->channels;
@@ -348,6 +378,49 @@ class FrameGrabber {
 
   AVCodecContext* getAudioContext() const { return aCodecCtx; }
 
+  const string& getInputUrl() const { return inputUrl; }
+
+  int getVideoIndex() const { return videoIndex; }
+  int getAudioIndex() const { return audioIndex; }
+
+  AVFormatContext* getFormatCtx() const { return formatCtx; }
+
+  /*
+   * seek to the keyframe at or before timestampMs, then the next grabbed frame starts there.
+   * With a keyframe index, the keyframe is found by binary search and reached by a byte seek.
+   */
+  bool seekTo(int64_t timestampMs, const KeyframeIndex* index = nullptr) {
+    bool sought = false;
+    if (index != nullptr) {
+      auto e = index->lookupMs(timestampMs);
+      if (e != nullptr) {
+        bool canSeekByte = !(formatCtx->iformat->flags & AVFMT_NO_BYTE_SEEK);
+        if (e->pos >= 0 && canSeekByte) {
+          sought = av_seek_frame(formatCtx, -1, e->pos, AVSEEK_FLAG_BYTE) >= 0;
+        }
+        if (!sought) {
+          sought = av_seek_frame(formatCtx, index->getStreamIndex(), e->pts,
+                                 AVSEEK_FLAG_BACKWARD) >= 0;
+        }
+      }
+    }
+
+    if (!sought) {
+      int64_t ts = av_rescale_q(timestampMs, AVRational{1, 1000}, AVRational{1, AV_TIME_BASE});
+      sought = av_seek_frame(formatCtx, -1, ts, AVSEEK_FLAG_BACKWARD) >= 0;
+    }
+
+    if (!sought) {
+      cout << "WARN: FrameGrabber seek failed, timestampMs=" << timestampMs << endl;
+      return false;
+    }
+
+    if (vCodecCtx != nullptr) avcodec_flush_buffers(vCodecCtx);
+    if (aCodecCtx != nullptr) avcodec_flush_buffers(aCodecCtx);
+    fileGotToEnd = false;
+    return true;
+  }
+
   int grabImageFrame(AVFrame* pFrame) {
     if (!videoEnabled) {
       throw std::runtime_error("video disabled.");
@@ -0,0 +1,169 @@
+#include "pch.h"
+#include "ffmpegUtil.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AudioMixer.h"
+#include "Player.h"
+#include "PacketPool.h"
+#include "PlayOptions.h"
+#include "ProcessUsage.h"
+#include "TaskExecutor.h"
+#include "VideoWall.h"
+
+extern "C" {
+#include "SDL/SDL.h"
+};
+
+namespace {
+
+using std::cout;
+using std::endl;
+
+const int COOPERATIVE_WIDTH = 1280;
+const int COOPERATIVE_HEIGHT = 720;
+// the audio callback may post a decode step meanwhile, the loop looks at least this often.
+const int COOPERATIVE_MAX_WAIT_MS = 10;
+const Uint32 COOPERATIVE_REPORT_MS = 5000;
+
+}  // namespace
+
+/*
+ * Play the files with one thread doing everything but the audio device callback:
+ * reading packets, decoding, converting and showing, all from this loop. Each round
+ * shows the frames that are due, reads what the decoders need and runs one decode step,
+ * the one whose consumer runs dry first. With nothing to do it sleeps on the SDL events
+ * until the next frame is due.
+ *
+ * The shared executor must have been configured COOPERATIVE before anything used it.
+ */
+void playCooperative(const std::vector<string>& inputFiles, const PlayOptions& options,
+                     int cols, bool offscreen) {
+  TaskExecutor& executor = TaskExecutor::shared();
+  if (!executor.isCooperative()) {
+    string errMsg = "playCooperative: the shared executor has worker threads.";
+    cout << errMsg << endl;
+    throw std::runtime_error(errMsg);
+  }
+  std::cout << "playCooperative: " << inputFiles.size() << " players"
+            << (offscreen ? ", offscreen" : "") << std::endl;
+  ProcessUsage usage{};
+
+  if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS)) {
+    string errMsg = "Could not initialize SDL -";
+    errMsg += SDL_GetError();
+    cout << errMsg << endl;
+    throw std::runtime_error(errMsg);
+  }
+
+  int count = (int)inputFiles.size();
+  std::unique_ptr<VideoTarget> target{};
+  if (offscreen) {
+    target.reset(new OffscreenVideoWall(count));
+  } else {
+    target.reset(new SdlVideoWall(count, cols, COOPERATIVE_WIDTH, COOPERATIVE_HEIGHT));
+  }
+  auto mixer = AudioMixer::openOptional(!offscreen, options.audioLatencyMs);
+
+  // one after the other, there is no thread to open them on.
+  PlayOptions playerOptions = options;
+  playerOptions.cooperative = true;
+  playerOptions.noAudio = mixer == nullptr;
+  std::vector<std::unique_ptr<Player>> players{};
+  for (int i = 0; i < count; i++) {
+    AudioSink* sink = mixer != nullptr ? &mixer->addInput() : nullptr;
+    // a refused file(memory budget, nothing to play) leaves its tile empty, the rest play.
+    try {
+      players.emplace_back(new Player(inputFiles[i], playerOptions, sink, i));
+    } catch (const std::runtime_error& e) {
+      cout << "WARN: tile " << i << " left empty: " << e.what() << endl;
+      if (mixer != nullptr) {
+        mixer->removeInput(sink);
+      }
+    }
+  }
+
+  bool quit = false;
+  bool paused = false;
+  int64_t steps = 0;
+  int64_t waits = 0;
+  Uint32 lastReport = SDL_GetTicks();
+  SDL_Event event;
+  bool got = false;
+  while (!quit) {
+    if (!got) {
+      got = paused ? SDL_WaitEvent(&event) : SDL_PollEvent(&event);
+    }
+    while (got) {
+      if (event.type == SDL_QUIT) {
+        cout << "SDL cooperative player got a SDL_QUIT." << endl;
+        quit = true;
+      } else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE) {
+        paused = !paused;
+        for (auto& p : players) {
+          p->setPaused(paused);
+        }
+        cout << (paused ? "pause" : "resume") << endl;
+      }
+      got = SDL_PollEvent(&event);
+    }
+    if (quit) {
+      break;
+    }
+    if (paused) {
+      continue;
+    }
+
+    bool allFinished = true;
+    bool shown = false;
+    for (auto& p : players) {
+      shown = p->refresh(*target) || shown;
+      p->readStep();
+      allFinished = allFinished && p->isFinished();
+    }
+    if (shown) {
+      target->present();
+    }
+    if (allFinished) {
+      break;
+    }
+
+    if (SDL_GetTicks() - lastReport >= COOPERATIVE_REPORT_MS) {
+      lastReport = SDL_GetTicks();
+      for (auto& p : players) {
+        p->printStats();
+      }
+      target->printStats();
+      cout << "cooperative: decode steps=" << steps << ", waits=" << waits << endl;
+    }
+
+    if (executor.runNext()) {
+      steps++;
+      continue;
+    }
+    // idle: sleep until a frame is due, readStep posts the refills of the audio callback.
+    int64_t waitMs = COOPERATIVE_MAX_WAIT_MS;
+    for (auto& p : players) {
+      int64_t until = p->untilNextFrameMs();
+      if (until > 0) {
+        waitMs = std::min(waitMs, until);
+      }
+    }
+    waits++;
+    got = SDL_WaitEventTimeout(&event, (int)waitMs) != 0;
+  }
+
+  for (auto& p : players) {
+    p->printStats();
+  }
+  target->printStats();
+  // the strands of the players run their last steps down on this thread.
+  players.clear();
+  cout << "cooperative player closed, decode steps=" << steps << ", waits=" << waits
+       << ", clipped samples=" << (mixer != nullptr ? mixer->getClippedSamples() : 0) << endl;
+  usage.print("cooperative player");
+  PacketPool::shared().printStats();
+}
@@ -0,0 +1,28 @@
+#include "ffmpegUtil.h"
+#include "KeyframeIndex.h"
+
+#include <iostream>
+#include <string>
+#include <chrono>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+ * Build '<inputPath>.kfi' for inputPath with a demux-only pass.
+ */
+void buildKeyframeIndex(const string& inputPath) {
+  using namespace ffmpegUtil;
+
+  auto t0 = std::chrono::steady_clock::now();
+  PacketGrabber packetGrabber{inputPath};
+  auto index = KeyframeIndex::build(packetGrabber);
+  auto outputPath = KeyframeIndex::sidecarPath(inputPath);
+  if (!index->save(outputPath)) {
+    throw std::runtime_error("can not save keyframe index: " + outputPath);
+  }
+  std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t0;
+  cout << "keyframe index saved: " << outputPath << ", keyframes=" << index->size()
+       << ", cost=" << (diff.count() * 1000) << "ms" << endl;
+}
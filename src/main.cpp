@@ -1,6 +1,16 @@
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
 #include "ffmpegUtil.h"
+#include "PlayOptions.h"
+#include "AudioTempo.h"
+#include "MemoryBudget.h"
+#include "Logger.h"
+#include "LockStats.h"
+#include "ThreadPolicy.h"
+#include "TaskExecutor.h"
 
 using std::cout;
 using std::endl;
@@ -10,17 +20,172 @@ namespace ffmpegUtil {
 extern void writeY420pFrame(std::ofstream& os, AVFrame* frame);
 }
 
-extern void playVideoWithAudio(const string& inputPath);
+extern void playVideoWithAudio(const string& inputPath, const PlayOptions& options);
+extern void playPlaylist(const std::vector<string>& inputPaths, const PlayOptions& options);
+extern void playWall(const std::vector<string>& inputPaths, const PlayOptions& options,
+                     int cols, bool offscreen);
+extern void playCooperative(const std::vector<string>& inputPaths, const PlayOptions& options,
+                            int cols, bool offscreen);
+extern void buildKeyframeIndex(const string& inputPath);
+extern void buildWaveform(const string& inputPath, int threads);
+extern void dumpYuv(const string& inputPath, const string& outputPath, bool directIo);
+extern void extractThumbnails(const string& inputPath, int64_t intervalMs, int thumbWidth,
+                              const string& outputPrefix);
+
+namespace {
+
+void printUsage() {
+  cout << "usage:" << endl;
+  cout << "  littlePlayer [--start <seconds>] [--volume <0..n>] [--mute] [--latency <ms>] "
+          "[--no-video] [--audio-sink sdl|openal] [--speed <0.5..4>]"
+       << endl;
+  cout << "               [--log-level debug|info|warn|error] [--lock-stats] "
+          "[--decode-cores <n,n,...>] [--rt-audio]"
+       << endl;
+  cout << "               [--downmix itu|dolby|<matrix>] <media file> [[--downmix ...] "
+          "<media file> ...]"
+       << endl;
+  cout << "  littlePlayer --wall <columns> [--offscreen] [--memory-limit <MB>] <media file> "
+          "[<media file> ...]"
+       << endl;
+  cout << "  littlePlayer --cooperative --wall <columns> [--offscreen] <media file> "
+          "[<media file> ...]"
+       << endl;
+  cout << "               single threaded video wall, all files play at once." << endl;
+  cout << "  littlePlayer [--prefetch <segments>] <manifest.seglist>" << endl;
+  cout << "  littlePlayer --build-index <media file> [<media file> ...]" << endl;
+  cout << "  littlePlayer --waveform [--threads <n>] <media file> [<media file> ...]" << endl;
+  cout << "  littlePlayer --dump <out.yuv|out.y4m> [--direct-io] <media file>" << endl;
+  cout << "  littlePlayer --thumbnails <interval seconds> [--thumb-width <pixels>] <media file>"
+       << endl;
+}
+
+}  // namespace
 
 int main(int argc, char* argv[]) {
   cout << "hello, little player." << endl;
-  if (argc != 2) {
+
+  PlayOptions options{};
+  std::vector<string> inputPaths{};
+  bool buildIndex = false;
+  bool waveform = false;
+  int threads = 0;
+  int64_t thumbIntervalMs = 0;
+  int thumbWidth = 320;
+  string dumpPath{};
+  bool directIo = false;
+  string downmix{};
+  int wallCols = 0;
+  bool offscreen = false;
+  bool cooperative = false;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--start" && i + 1 < argc) {
+      options.startMs = (int64_t)(std::atof(argv[++i]) * 1000);
+    } else if (arg == "--prefetch" && i + 1 < argc) {
+      options.segmentPrefetch = std::atoi(argv[++i]);
+    } else if (arg == "--volume" && i + 1 < argc) {
+      options.volume = (float)std::atof(argv[++i]);
+    } else if (arg == "--mute") {
+      options.mute = true;
+    } else if (arg == "--no-video") {
+      options.noVideo = true;
+    } else if (arg == "--audio-sink" && i + 1 < argc) {
+      options.audioSink = argv[++i];
+    } else if (arg == "--speed" && i + 1 < argc) {
+      options.speed = ffmpegUtil::AudioTempo::clamp(std::atof(argv[++i]));
+    } else if (arg == "--memory-limit" && i + 1 < argc) {
+      MemoryBudget::shared().setLimit((int64_t)(std::atof(argv[++i]) * 1024 * 1024));
+    } else if (arg == "--log-level" && i + 1 < argc) {
+      Logger::shared().setLevel(Logger::parseLevel(argv[++i]));
+    } else if (arg == "--lock-stats") {
+      LockStats::shared().setEnabled(true);
+    } else if (arg == "--decode-cores" && i + 1 < argc) {
+      ThreadPolicy::shared().setDecodeCores(ThreadPolicy::parseCores(argv[++i]));
+    } else if (arg == "--rt-audio") {
+      ThreadPolicy::shared().setRealtimeAudio(true);
+    } else if (arg == "--latency" && i + 1 < argc) {
+      options.audioLatencyMs = std::atoi(argv[++i]);
+    } else if (arg == "--wall" && i + 1 < argc) {
+      wallCols = std::atoi(argv[++i]);
+    } else if (arg == "--cooperative") {
+      cooperative = true;
+      TaskExecutor::configureShared(TaskExecutor::COOPERATIVE);
+    } else if (arg == "--offscreen") {
+      offscreen = true;
+    } else if (arg == "--build-index") {
+      buildIndex = true;
+    } else if (arg == "--waveform") {
+      waveform = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+    } else if (arg == "--dump" && i + 1 < argc) {
+      dumpPath = argv[++i];
+    } else if (arg == "--direct-io") {
+      directIo = true;
+    } else if (arg == "--thumbnails" && i + 1 < argc) {
+      thumbIntervalMs = (int64_t)(std::atof(argv[++i]) * 1000);
+    } else if (arg == "--thumb-width" && i + 1 < argc) {
+      thumbWidth = std::atoi(argv[++i]);
+    } else if (arg == "--downmix" && i + 1 < argc) {
+      downmix = argv[++i];
+    } else if (arg.compare(0, 2, "--") != 0) {
+      inputPaths.push_back(arg);
+      // a --downmix applies to the files after it.
+      if (!downmix.empty()) {
+        options.fileDownmix[arg] = downmix;
+      }
+    } else {
+      cout << "input error: unknown argument [" << arg << "]" << endl;
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (inputPaths.empty()) {
+    cout << "input error:" << endl;
+    cout << "the media file should be given." << endl;
+    printUsage();
+    return 1;
+  }
+
+  // the cooperative loop only drives a wall, a single file or a playlist would turn into one.
+  if (cooperative && wallCols <= 0) {
     cout << "input error:" << endl;
-    cout << "arg[1] should be the media file." << endl;
+    cout << "--cooperative plays a video wall only, give --wall <columns> too." << endl;
+    printUsage();
+    return 1;
+  }
+
+  if (buildIndex) {
+    for (auto& inputPath : inputPaths) {
+      cout << "build keyframe index:" << inputPath << endl;
+      buildKeyframeIndex(inputPath);
+    }
+  } else if (waveform) {
+    for (auto& inputPath : inputPaths) {
+      cout << "build waveform:" << inputPath << endl;
+      buildWaveform(inputPath, threads);
+    }
+  } else if (!dumpPath.empty()) {
+    cout << "dump yuv:" << inputPaths[0] << " => " << dumpPath << endl;
+    dumpYuv(inputPaths[0], dumpPath, directIo);
+  } else if (thumbIntervalMs > 0) {
+    for (auto& inputPath : inputPaths) {
+      cout << "extract thumbnails:" << inputPath << endl;
+      extractThumbnails(inputPath, thumbIntervalMs, thumbWidth, inputPath);
+    }
+  } else if (cooperative) {
+    playCooperative(inputPaths, options, wallCols, offscreen);
+  } else if (wallCols > 0) {
+    playWall(inputPaths, options, wallCols, offscreen);
+  } else if (inputPaths.size() == 1) {
+    cout << "play file:" << inputPaths[0] << endl;
+    playVideoWithAudio(inputPaths[0], options);
   } else {
-    string inputPath = argv[1];
-    cout << "play file:" << inputPath << endl;
-    playVideoWithAudio(inputPath);
+    // playlist, the next item is opened while the current one is playing.
+    playPlaylist(inputPaths, options);
   }
   return 0;
-}
\ No newline at end of file
+}
@@ -12,7 +12,19 @@
 #include <memory>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <vector>
 #include "MediaProcessor.hpp"
+#include "MediaItem.h"
+#include "PlayOptions.h"
+#include "AudioSink.h"
+#include "SdlAudioSink.h"
+#include "OpenALAudioSink.h"
+#include "StopSignal.h"
+#include "Logger.h"
+#include "ThreadPolicy.h"
 
 extern "C" {
 #include "SDL/SDL.h"
@@ -32,96 +44,237 @@ using namespace ffmpegUtil;
 using std::cout;
 using std::endl;
 
-void sdlAudioCallback(void* userdata, Uint8* stream, int len) {
-  AudioProcessor* receiver = (AudioProcessor*)userdata;
-  receiver->writeAudioData(stream, len);
+// the display is not refreshed faster than this, fast playback drops frames instead.
+const int MIN_REFRESH_INTERVAL_MS = 16;
+
+// playback speeds the [ and ] keys step through.
+const double SPEED_STEPS[] = {0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 4.0};
+
+int refreshInterval(double frameRate, double speed) {
+  return std::max(MIN_REFRESH_INTERVAL_MS, (int)(1000 / frameRate / speed));
 }
 
-void pktReader(PacketGrabber& pGrabber, AudioProcessor* aProcessor,
-               VideoProcessor* vProcessor) {
-  const int CHECK_PERIOD = 10;
-
-  cout << "INFO: pkt Reader thread started." << endl;
-  int audioIndex = aProcessor->getAudioIndex();
-  int videoIndex = vProcessor->getVideoIndex();
-
-  while (!pGrabber.isFileEnd() && !aProcessor->isClosed() && !vProcessor->isClosed()) {
-    while (aProcessor->needPacket() || vProcessor->needPacket()) {
-      AVPacket* packet = (AVPacket*)av_malloc(sizeof(AVPacket));
-      int t = pGrabber.grabPacket(packet);
-      if (t == -1) {
-        cout << "INFO: file finish." << endl;
-        aProcessor->pushPkt(nullptr);
-        vProcessor->pushPkt(nullptr);
-        break;
-      } else if (t == audioIndex && aProcessor != nullptr) {
-        unique_ptr<AVPacket> uPacket(packet);
-        aProcessor->pushPkt(std::move(uPacket));
-      } else if (t == videoIndex && vProcessor != nullptr) {
-        unique_ptr<AVPacket> uPacket(packet);
-        vProcessor->pushPkt(std::move(uPacket));
-      } else {
-        av_packet_free(&packet);
-        cout << "WARN: unknown streamIndex: [" << t << "]" << endl;
-      }
+double stepSpeed(double speed, bool up) {
+  const int n = sizeof(SPEED_STEPS) / sizeof(SPEED_STEPS[0]);
+  if (up) {
+    for (int i = 0; i < n; i++) {
+      if (SPEED_STEPS[i] > speed) return SPEED_STEPS[i];
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(CHECK_PERIOD));
+    return SPEED_STEPS[n - 1];
   }
-  cout << "[THREAD] INFO: pkt Reader thread finished." << endl;
+  for (int i = n - 1; i >= 0; i--) {
+    if (SPEED_STEPS[i] < speed) return SPEED_STEPS[i];
+  }
+  return SPEED_STEPS[0];
 }
 
-void picRefresher(int timeInterval, bool& exitRefresh, bool& faster) {
-  cout << "picRefresher timeInterval[" << timeInterval << "]" << endl;
-  while (!exitRefresh) {
+void picRefresher(std::atomic<int>& timeInterval, StopSignal& exitRefresh,
+                  std::atomic<bool>& faster) {
+  ThreadPolicy::shared().apply("lp-refresh", ThreadRole::REFRESH);
+  cout << "picRefresher timeInterval[" << timeInterval.load() << "]" << endl;
+  while (!exitRefresh.isStopped()) {
     SDL_Event event;
     event.type = REFRESH_EVENT;
     SDL_PushEvent(&event);
-    if (faster) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(timeInterval / 2));
+    if (faster.load()) {
+      exitRefresh.waitFor(timeInterval.load() / 2);
     } else {
-      std::this_thread::sleep_for(std::chrono::milliseconds(timeInterval));
+      exitRefresh.waitFor(timeInterval.load());
     }
   }
   cout << "[THREAD] picRefresher thread finished." << endl;
 }
 
-void playSdlVideo(VideoProcessor& vProcessor, AudioProcessor* audio = nullptr) {
-  //--------------------- GET SDL window READY -------------------
+/*
+ * SDL window, renderer and texture, kept alive across playlist items.
+ * The window is only created once, the texture only when the picture size changes.
+ */
+struct SdlVideoOutput {
+  SDL_Window* screen = nullptr;
+  SDL_Renderer* sdlRenderer = nullptr;
+  SDL_Texture* sdlTexture = nullptr;
+  int width = -1;
+  int height = -1;
+
+  SdlVideoOutput() = default;
+  SdlVideoOutput(const SdlVideoOutput&) = delete;
+  SdlVideoOutput& operator=(const SdlVideoOutput&) = delete;
+
+  ~SdlVideoOutput() {
+    if (sdlTexture != nullptr) SDL_DestroyTexture(sdlTexture);
+    if (sdlRenderer != nullptr) SDL_DestroyRenderer(sdlRenderer);
+    if (screen != nullptr) SDL_DestroyWindow(screen);
+  }
 
-  auto width = vProcessor.getWidth();
-  auto height = vProcessor.getHeight();
+  /*
+   * video subsystem, window and renderer, the window stays hidden until prepare.
+   * Called ahead, while the decoders prime. Only prepare requires it, audio only
+   * playback needs no display.
+   *  return
+   *          false  : no display, and not required
+   */
+  bool open(bool required) {
+    if (screen != nullptr) {
+      return true;
+    }
+    if (!SDL_WasInit(SDL_INIT_VIDEO) && SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+      string errMsg = "Could not initialize SDL video -";
+      errMsg += SDL_GetError();
+      cout << errMsg << endl;
+      if (!required) {
+        return false;
+      }
+      throw std::runtime_error(errMsg);
+    }
+    // SDL 2.0 Support for multiple windows
+    screen = SDL_CreateWindow("Simplest Video Play SDL2", SDL_WINDOWPOS_UNDEFINED,
+                              SDL_WINDOWPOS_UNDEFINED, 640, 360,
+                              SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIDDEN);
+    if (!screen) {
+      string errMsg = "SDL: could not create window - exiting:";
+      errMsg += SDL_GetError();
+      cout << errMsg << endl;
+      throw std::runtime_error(errMsg);
+    }
+    sdlRenderer = SDL_CreateRenderer(screen, -1, 0);
+    return true;
+  }
 
-  SDL_Window* screen;
-  // SDL 2.0 Support for multiple windows
-  screen = SDL_CreateWindow("Simplest Video Play SDL2", SDL_WINDOWPOS_UNDEFINED,
-                            SDL_WINDOWPOS_UNDEFINED, width / 2, height / 2,
-                            SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
-  if (!screen) {
-    string errMsg = "SDL: could not create window - exiting:";
-    errMsg += SDL_GetError();
-    cout << errMsg << endl;
-    throw std::runtime_error(errMsg);
+  void prepare(int w, int h) {
+    if (screen != nullptr && w == width && h == height) {
+      cout << "SdlVideoOutput: reuse window and texture." << endl;
+      return;
+    }
+    open(true);
+    SDL_SetWindowSize(screen, w / 2, h / 2);
+    SDL_ShowWindow(screen);
+
+    if (sdlTexture != nullptr) {
+      SDL_DestroyTexture(sdlTexture);
+    }
+
+    // IYUV: Y + U + V  (3 planes)
+    // YV12: Y + V + U  (3 planes)
+    Uint32 pixformat = SDL_PIXELFORMAT_IYUV;
+
+    sdlTexture = SDL_CreateTexture(sdlRenderer, pixformat, SDL_TEXTUREACCESS_STREAMING, w, h);
+    width = w;
+    height = h;
+  }
+};
+
+/*
+ * time of each startup phase since the first file was given, the phases overlap.
+ */
+class StartupTrace {
+  const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  std::mutex mtx{};
+
+ public:
+  void mark(const char* phase) {
+    std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t0;
+    std::lock_guard<std::mutex> lk{mtx};
+    cout << "startup [" << phase << "]: +" << (diff.count() * 1000) << "ms" << endl;
+  }
+};
+
+/*
+ * master clock of video without audio: the wall clock scaled by the speed,
+ * starting at the pts of the first shown frame. It stands still while paused.
+ */
+struct SpeedClock {
+  uint64_t baseMs = 0;
+  Uint32 baseTicks = 0;
+  double speed = 1.0;
+  bool started = false;
+  bool paused = false;
+
+  void start(uint64_t pts) {
+    baseMs = pts;
+    baseTicks = SDL_GetTicks();
+    started = true;
+  }
+
+  uint64_t nowMs() const {
+    if (paused) {
+      return baseMs;
+    }
+    return baseMs + (uint64_t)((SDL_GetTicks() - baseTicks) * speed);
+  }
+
+  void pause() {
+    baseMs = nowMs();
+    paused = true;
+  }
+
+  void resume() {
+    baseTicks = SDL_GetTicks();
+    paused = false;
+  }
+
+  void setSpeed(double s) {
+    if (started) {
+      start(nowMs());
+    }
+    speed = s;
   }
+};
+
+
+void reportAudio(AudioProcessor& audio, AudioSink& sink) {
+  AudioLatencyStats stats = audio.getLatencyStats();
+  cout << "audio latency[" << sink.getName() << "]: decode to device avg=" << stats.avgMs
+       << "ms, max=" << stats.maxMs << "ms (device buffer=" << stats.deviceMs
+       << "ms, queue=" << stats.queueMs << "ms), callbacks=" << stats.callbacks
+       << ", underruns=" << stats.underruns << endl;
+  MeterReading meter{};
+  if (audio.getMeterReading(meter)) {
+    cout << "audio meter: short-term=" << meter.shortTermLufs << "LUFS";
+    for (int c = 0; c < meter.channels; c++) {
+      cout << ", ch" << c << " peak=" << meter.peakDb[c] << "dB rms=" << meter.rmsDb[c]
+           << "dB";
+    }
+    cout << endl;
+  }
+  sink.printStats();
+  MemoryBudget::shared().printUsage();
+  LockStats::shared().printUsage();
+}
 
-  SDL_Renderer* sdlRenderer = SDL_CreateRenderer(screen, -1, 0);
+/*
+ * play video of one item on the output.
+ *  return
+ *          true   : the stream finished, go on with the next item
+ *          false  : user closed the window
+ */
+bool playSdlVideo(MediaItem& item, SdlVideoOutput& output, double& speed,
+                  AudioSink* sink = nullptr, StartupTrace* trace = nullptr) {
+  VideoProcessor& vProcessor = *item.videoProcessor;
+  AudioProcessor* audio = item.audioProcessor.get();
+  //--------------------- GET SDL window READY -------------------
 
-  // IYUV: Y + U + V  (3 planes)
-  // YV12: Y + V + U  (3 planes)
-  Uint32 pixformat = SDL_PIXELFORMAT_IYUV;
+  output.prepare(vProcessor.getWidth(), vProcessor.getHeight());
+  SDL_Renderer* sdlRenderer = output.sdlRenderer;
+  SDL_Texture* sdlTexture = output.sdlTexture;
 
-  SDL_Texture* sdlTexture =
-      SDL_CreateTexture(sdlRenderer, pixformat, SDL_TEXTUREACCESS_STREAMING, width, height);
   // Use this function to update a rectangle within a planar
   // YV12 or IYUV texture with new pixel data.
   SDL_Event event;
   auto frameRate = vProcessor.getFrameRate();
   cout << "frame rate [" << frameRate << "]" << endl;
 
-  bool exitRefresh = false;
-  bool faster = false;
-  std::thread refreshThread{picRefresher, (int)(1000 / frameRate), std::ref(exitRefresh),
+  StopSignal exitRefresh{};
+  std::atomic<bool> faster{false};
+  std::atomic<int> interval{refreshInterval(frameRate, speed)};
+  std::thread refreshThread{picRefresher, std::ref(interval), std::ref(exitRefresh),
                             std::ref(faster)};
 
+  SpeedClock videoClock{};
+  videoClock.speed = speed;
+
+  bool quit = false;
+  bool paused = false;
+  Uint32 lastLatencyReport = SDL_GetTicks();
   int failCount = 0;
   int fastCount = 0;
   int slowCount = 0;
@@ -129,24 +282,40 @@ void playSdlVideo(VideoProcessor& vProcessor, AudioProcessor* audio = nullptr) {
     SDL_WaitEvent(&event);
 
     if (event.type == REFRESH_EVENT) {
+      if (paused) {
+        continue;  // one may still be queued from before the pause.
+      }
       if (vProcessor.isStreamFinished()) {
-        exitRefresh = true;
+        exitRefresh.stop();
         continue;  // skip REFRESH event.
       }
 
-      if (audio != nullptr) {
+      if (audio != nullptr && sink != nullptr && SDL_GetTicks() - lastLatencyReport >= 5000) {
+        lastLatencyReport = SDL_GetTicks();
+        reportAudio(*audio, *sink);
+      }
+
+      if (audio != nullptr || videoClock.started) {
         auto vTs = vProcessor.getPts();
-        auto aTs = audio->getPts();
+        // the sink knows what is heard right now.
+        uint64_t aTs;
+        if (audio == nullptr) {
+          aTs = videoClock.nowMs();
+        } else {
+          aTs = sink != nullptr ? sink->getClockMs() : audio->getPts();
+        }
+        // far behind, e.g. at a high speed: drop frames before they are converted.
+        bool late = vTs < aTs && aTs - vTs > (uint64_t)(interval.load() * 2 * speed);
+        vProcessor.setDropBefore(late ? aTs : 0);
         if (vTs > aTs && vTs - aTs > 30) {
-          cout << "VIDEO FASTER ================= vTs - aTs [" << (vTs - aTs)
-               << "]ms, SKIP A EVENT" << endl;
+          LOGI("VIDEO FASTER ================= vTs - aTs [%d]ms, SKIP A EVENT",
+               (int)(vTs - aTs));
           // skip a REFRESH_EVENT
           faster = false;
           slowCount++;
           continue;
         } else if (vTs < aTs && aTs - vTs > 30) {
-          cout << "VIDEO SLOWER ================= aTs - vTs =[" << (aTs - vTs) << "]ms, Faster"
-               << endl;
+          LOGI("VIDEO SLOWER ================= aTs - vTs =[%d]ms, Faster", (int)(aTs - vTs));
           faster = true;
           fastCount++;
         } else {
@@ -161,6 +330,9 @@ void playSdlVideo(VideoProcessor& vProcessor, AudioProcessor* audio = nullptr) {
       AVFrame* frame = vProcessor.getFrame();
 
       if (frame != nullptr) {
+        if (!videoClock.started && audio == nullptr) {
+          videoClock.start(vProcessor.getPts());
+        }
         SDL_UpdateYUVTexture(sdlTexture,  // the texture to update
                              NULL,        // a pointer to the rectangle of pixels to update, or
                                           // NULL to update the entire texture
@@ -177,18 +349,55 @@ void playSdlVideo(VideoProcessor& vProcessor, AudioProcessor* audio = nullptr) {
         SDL_RenderClear(sdlRenderer);
         SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, NULL);
         SDL_RenderPresent(sdlRenderer);
+        if (trace != nullptr) {
+          trace->mark("first video frame");
+          trace = nullptr;
+        }
 
         if (!vProcessor.refreshFrame()) {
           cout << "WARN: vProcessor.refreshFrame false" << endl;
         }
       } else {
         failCount++;
-        cout << "WARN: getFrame fail. failCount = " << failCount << endl;
+        LOGW("getFrame fail. failCount = %d", failCount);
       }
 
+    } else if (event.type == SDL_KEYDOWN) {
+      // up/down: volume, m: mute, [ and ]: speed, space: pause.
+      auto key = event.key.keysym.sym;
+      if (key == SDLK_SPACE) {
+        // the refresher, the reader and the decoders park, the device holds its buffer.
+        paused = !paused;
+        exitRefresh.setPaused(paused);
+        item.setPaused(paused);
+        if (audio != nullptr && sink != nullptr) {
+          sink->setPaused(paused);
+        }
+        if (paused) {
+          videoClock.pause();
+        } else {
+          videoClock.resume();
+        }
+        cout << (paused ? "pause" : "resume") << endl;
+      } else if (key == SDLK_LEFTBRACKET || key == SDLK_RIGHTBRACKET) {
+        speed = stepSpeed(speed, key == SDLK_RIGHTBRACKET);
+        applySpeed(&vProcessor, audio, speed);
+        videoClock.setSpeed(speed);
+        interval.store(refreshInterval(frameRate, speed));
+        cout << "speed: " << speed << "x" << endl;
+      } else if (audio == nullptr) {
+        continue;
+      } else if (key == SDLK_UP || key == SDLK_DOWN) {
+        float volume = audio->getVolume() + (key == SDLK_UP ? 0.1f : -0.1f);
+        audio->setVolume(volume < 0 ? 0 : volume);
+        cout << "volume: " << audio->getVolume() << endl;
+      } else if (key == SDLK_m) {
+        audio->setMute(!audio->isMuted());
+        cout << "mute: " << audio->isMuted() << endl;
+      }
     } else if (event.type == SDL_QUIT) {
       cout << "SDL screen got a SDL_QUIT." << endl;
-      exitRefresh = true;
+      quit = true;
       // close window.
       break;
     } else if (event.type == BREAK_EVENT) {
@@ -196,74 +405,39 @@ void playSdlVideo(VideoProcessor& vProcessor, AudioProcessor* audio = nullptr) {
     }
   }
 
+  exitRefresh.stop();
   refreshThread.join();
   cout << "[THREAD] Sdl video thread finish: failCount = " << failCount << ", fastCount = " << fastCount
-       << ", slowCount = " << slowCount << endl;
+       << ", slowCount = " << slowCount << ", dropped = " << vProcessor.getDroppedFrames()
+       << endl;
+  return !quit;
 }
 
-void startSdlAudio(SDL_AudioDeviceID& audioDeviceID, AudioProcessor& aProcessor) {
-  //--------------------- GET SDL audio READY -------------------
-
-  // audio specs containers
-  SDL_AudioSpec wanted_specs;
-  SDL_AudioSpec specs;
-
-  cout << "aProcessor.getSampleFormat() = " << aProcessor.getSampleFormat() << endl;
-  cout << "aProcessor.getSampleRate() = " << aProcessor.getOutSampleRate() << endl;
-  cout << "aProcessor.getChannels() = " << aProcessor.getOutChannels() << endl;
-  cout << "++" << endl;
-
-  int samples = -1;
-  while (true) {
-    cout << "getting audio samples." << endl;
-    samples = aProcessor.getSamples();
-    if (samples <= 0) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    } else {
-      cout << "get audio samples:" << samples << endl;
-      break;
+/*
+ * audio only playback, there is no window and nothing to refresh.
+ * This thread sleeps on SDL events, the decoder sleeps until its queue runs low.
+ *  return
+ *          true   : the stream finished, go on with the next item
+ *          false  : got a SDL_QUIT(ctrl-c)
+ */
+bool playSdlAudio(AudioProcessor& audio, AudioSink& sink) {
+  SDL_Event event;
+  Uint32 lastLatencyReport = SDL_GetTicks();
+  while (!audio.isDrained()) {
+    if (SDL_WaitEventTimeout(&event, 500) && event.type == SDL_QUIT) {
+      cout << "SDL got a SDL_QUIT." << endl;
+      return false;
+    }
+    if (SDL_GetTicks() - lastLatencyReport >= 5000) {
+      lastLatencyReport = SDL_GetTicks();
+      reportAudio(audio, sink);
     }
   }
-
-  // set audio settings from codec info
-  wanted_specs.freq = aProcessor.getOutSampleRate();
-  wanted_specs.format = AUDIO_S16SYS;
-  wanted_specs.channels = aProcessor.getOutChannels();
-  wanted_specs.samples = samples;
-  wanted_specs.callback = sdlAudioCallback;
-  wanted_specs.userdata = &aProcessor;
-
-  // open audio device
-  audioDeviceID = SDL_OpenAudioDevice(nullptr, 0, &wanted_specs, &specs, 0);
-
-  // SDL_OpenAudioDevice returns a valid device ID that is > 0 on success or 0 on failure
-  if (audioDeviceID == 0) {
-    string errMsg = "Failed to open audio device:";
-    errMsg += SDL_GetError();
-    cout << errMsg << endl;
-    throw std::runtime_error(errMsg);
-  }
-
-  cout << "wanted_specs.freq:" << wanted_specs.freq << endl;
-  // cout << "wanted_specs.format:" << wanted_specs.format << endl;
-  std::printf("wanted_specs.format: Ox%X\n", wanted_specs.format);
-  cout << "wanted_specs.channels:" << (int)wanted_specs.channels << endl;
-  cout << "wanted_specs.samples:" << (int)wanted_specs.samples << endl;
-
-  cout << "------------------------------------------------" << endl;
-
-  cout << "specs.freq:" << specs.freq << endl;
-  // cout << "specs.format:" << specs.format << endl;
-  std::printf("specs.format: Ox%X\n", specs.format);
-  cout << "specs.channels:" << (int)specs.channels << endl;
-  cout << "specs.silence:" << (int)specs.silence << endl;
-  cout << "specs.samples:" << (int)specs.samples << endl;
-
-
-  SDL_PauseAudioDevice(audioDeviceID, 0);
-  cout << "[THREAD] audio start thread finish." << endl;
+  cout << "[THREAD] Sdl audio only playback finish." << endl;
+  return true;
 }
 
+
 int play_debug(const string& inputFile) {
   // create packet grabber
   PacketGrabber packetGrabber{ inputFile };
@@ -278,9 +452,12 @@ int play_debug(const string& inputFile) {
   audioProcessor.start();
   cout << " ---   2   ---------- " << endl;
 
-  std::thread readerThread{ pktReader, std::ref(packetGrabber), &audioProcessor, &videoProcessor };
+  StopSignal readerStop{};
+  std::thread readerThread{pktReader, std::ref(packetGrabber), &audioProcessor,
+                           &videoProcessor, 10, std::ref(readerStop)};
 
   cout << " ---   3   ---------- " << endl;
+  readerStop.stop();
   videoProcessor.close();
   audioProcessor.close();
   cout << " ---   4   ---------- " << endl;
@@ -292,69 +469,119 @@ int play_debug(const string& inputFile) {
 
 }
 
-int play(const string& inputFile) {
-  // create packet grabber
-  PacketGrabber packetGrabber{inputFile};
-  auto formatCtx = packetGrabber.getFormatCtx();
-  av_dump_format(formatCtx, 0, "", 0);
-
-  VideoProcessor videoProcessor(formatCtx);
-  videoProcessor.start();
-
-  // create AudioProcessor
-  AudioProcessor audioProcessor(formatCtx);
-  audioProcessor.start();
-
+unique_ptr<AudioSink> createAudioSink(const PlayOptions& options) {
+  if (options.audioSink == "openal") {
+    return unique_ptr<AudioSink>{new OpenALAudioSink(options.audioLatencyMs)};
+  } else if (options.audioSink != "sdl") {
+    cout << "WARN: unknown audio sink [" << options.audioSink << "], use sdl." << endl;
+  }
+  return unique_ptr<AudioSink>{new SdlAudioSink(options.audioLatencyMs)};
+}
 
+void attachAudio(AudioSink& audioOutput, MediaItem& item) {
+  if (item.audioProcessor != nullptr) {
+    audioOutput.attach(*item.audioProcessor);
+  } else {
+    // a silent item, the device keeps playing silence.
+    audioOutput.detach();
+  }
+}
 
-  // start pkt reader
-  std::thread readerThread{pktReader, std::ref(packetGrabber), &audioProcessor,
-                           &videoProcessor};
+int play(const std::vector<string>& inputFiles, const PlayOptions& options) {
+  if (options.audioLatencyMs > 0) {
+    // let ALSA use exactly the requested buffer, instead of its own larger default.
+    SDL_setenv("SDL_AUDIO_ALSA_SET_BUFFER_SIZE", "1", 1);
+  }
 
-  SDL_setenv("SDL_AUDIO_ALSA_SET_BUFFER_SIZE", "1", 1);
+  StartupTrace trace{};
+  // the decoders prime on the executor while SDL, the device and the window come up.
+  auto opening = std::async(std::launch::async, openMediaItem, inputFiles[0],
+                            std::cref(options));
 
-  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER)) {
+  if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_TIMER | SDL_INIT_EVENTS)) {
     string errMsg = "Could not initialize SDL -";
     errMsg += SDL_GetError();
     cout << errMsg << endl;
     throw std::runtime_error(errMsg);
   }
-  
-
-  SDL_AudioDeviceID audioDeviceID;
-
-  std::thread startAudioThread(startSdlAudio, std::ref(audioDeviceID),
-                               std::ref(audioProcessor));
-  startAudioThread.join();
-
-  std::thread videoThread{playSdlVideo, std::ref(videoProcessor), &audioProcessor};
-
-
-  cout << "videoThread join." << endl;
-  videoThread.join();
-
-  SDL_PauseAudioDevice(audioDeviceID, 1);
-  SDL_CloseAudio();
+  trace.mark("sdl init");
+
+  SdlVideoOutput videoOutput{};
+  auto audioSink = createAudioSink(options);
+  AudioSink& audioOutput = *audioSink;
+
+  // the device opens as soon as the first audio frame is decoded, the window meanwhile.
+  auto attaching = std::async(std::launch::async, [&opening, &audioOutput, &trace] {
+    auto item = opening.get();
+    trace.mark("file opened, decoders started");
+    attachAudio(audioOutput, *item);
+    trace.mark("audio device open");
+    return item;
+  });
+  if (!options.noVideo && videoOutput.open(false)) {
+    trace.mark("window created");
+  }
+  auto current = attaching.get();
+
+  // only the first item starts from the given position.
+  PlayOptions nextOptions = options;
+  nextOptions.startMs = 0;
+  // changed by the keys during playback, kept for the following items.
+  double speed = options.speed;
+
+  for (size_t i = 0; i < inputFiles.size(); i++) {
+    // open and prime the next item while the current one is playing.
+    std::future<unique_ptr<MediaItem>> next{};
+    if (i + 1 < inputFiles.size()) {
+      next = std::async(std::launch::async, openMediaItem, inputFiles[i + 1],
+                        std::cref(nextOptions));
+    }
 
-  bool r;
-  r = audioProcessor.close();
-  cout << "audioProcessor closed: " << r << endl;
-  r = videoProcessor.close();
-  cout << "videoProcessor closed: " << r << endl;
+    cout << "play item [" << i << "]: " << current->inputFile << endl;
+    bool goOn;
+    if (current->videoProcessor != nullptr) {
+      goOn = playSdlVideo(*current, videoOutput, speed, &audioOutput,
+                          i == 0 ? &trace : nullptr);
+    } else {
+      goOn = playSdlAudio(*current->audioProcessor, audioOutput);
+    }
+    if (current->audioProcessor != nullptr) {
+      reportAudio(*current->audioProcessor, audioOutput);
+    }
+    if (!goOn || !next.valid()) {
+      break;
+    }
 
-  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // switch the output first, the finished item is torn down afterwards.
+    auto nextItem = next.get();
+    if (current->audioProcessor != nullptr && nextItem->audioProcessor != nullptr) {
+      // keep the volume the user has set during playback.
+      nextItem->audioProcessor->setVolume(current->audioProcessor->getVolume());
+      nextItem->audioProcessor->setMute(current->audioProcessor->isMuted());
+    }
+    applySpeed(nextItem->videoProcessor.get(), nextItem->audioProcessor.get(), speed);
+    attachAudio(audioOutput, *nextItem);
+    current = std::move(nextItem);
+  }
 
-  readerThread.join();
+  audioOutput.detach();
+  audioOutput.close();
+  current.reset();
   cout << "Pause and Close audio" << endl;
 
   return 0;
-
 }
 
 }  // namespace
 
-void playVideoWithAudio(const string& inputFile) {
+void playVideoWithAudio(const string& inputFile, const PlayOptions& options) {
   std::cout << "playVideoWithAudio: " << inputFile << std::endl;
 
-  play(inputFile);
+  play({inputFile}, options);
+}
+
+void playPlaylist(const std::vector<string>& inputFiles, const PlayOptions& options) {
+  std::cout << "playPlaylist: " << inputFiles.size() << " items" << std::endl;
+
+  play(inputFiles, options);
 }
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "ffmpegUtil.h"
+#include "KeyframeIndex.h"
+#include "test/FrameGrabber.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace {
+
+using namespace ffmpegUtil;
+
+void writePpm(const string& path, AVFrame* rgb, int width, int height) {
+  std::ofstream os{path, std::ios::binary};
+  os << "P6\n" << width << " " << height << "\n255\n";
+  for (int i = 0; i < height; i++) {
+    os.write(reinterpret_cast<char*>(rgb->data[0] + (int64_t)i * rgb->linesize[0]), width * 3);
+  }
+}
+
+}  // namespace
+
+/*
+ * Extract one thumbnail every intervalMs into '<outputPrefix>_<ms>.ppm'.
+ *
+ * Only keyframes are decoded: the decoder drops non-key frames(skip_frame=AVDISCARD_NONKEY),
+ * and the grabber seeks straight to the keyframe of each interval, so the job is bound by
+ * I/O instead of decoding. Frames are scaled directly to the thumbnail size.
+ */
+void extractThumbnails(const string& inputPath, int64_t intervalMs, int thumbWidth,
+                       const string& outputPrefix) {
+  auto t0 = std::chrono::steady_clock::now();
+  if (thumbWidth <= 0) {
+    string errMsg = "thumbnail width must be positive: " + std::to_string(thumbWidth);
+    cout << errMsg << endl;
+    throw std::runtime_error(errMsg);
+  }
+
+  FrameGrabber grabber{inputPath, true, false};
+  grabber.start();
+  grabber.setKeyframeOnly(true);
+
+  // the sidecar keyframe index makes each seek a binary search plus a byte seek.
+  std::unique_ptr<KeyframeIndex> index =
+      KeyframeIndex::load(KeyframeIndex::sidecarPath(inputPath), grabber.getFormatCtx());
+  if (index != nullptr) {
+    cout << "keyframe index loaded, keyframes=" << index->size() << endl;
+  }
+
+  int width = grabber.getWidth();
+  int height = grabber.getHeight();
+  int thumbHeight = width > 0 ? (int)av_rescale(height, thumbWidth, width) & ~1 : 0;
+  if (thumbHeight < 2) {
+    grabber.close();
+    string errMsg = "no thumbnail of width " + std::to_string(thumbWidth) + " for " +
+                    std::to_string(width) + "x" + std::to_string(height) + " video.";
+    cout << errMsg << endl;
+    throw std::runtime_error(errMsg);
+  }
+
+  AVFrame* frame = av_frame_alloc();
+  AVFrame* thumb = av_frame_alloc();
+  if (av_image_alloc(thumb->data, thumb->linesize, thumbWidth, thumbHeight, AV_PIX_FMT_RGB24,
+                     32) < 0) {
+    av_frame_free(&thumb);
+    av_frame_free(&frame);
+    grabber.close();
+    throw std::runtime_error("av_image_alloc failed for the thumbnail.");
+  }
+  struct SwsContext* swsCtx = nullptr;
+
+  auto timeBase = grabber.getVideoTimeBase();
+  auto durationMs = grabber.getDurationMs();
+  int64_t lastPts = AV_NOPTS_VALUE;
+  int count = 0;
+
+  for (int64_t t = 0; durationMs < 0 || t < durationMs; t += intervalMs) {
+    if (t > 0 && !grabber.seekTo(t, index.get())) {
+      break;
+    }
+
+    int ret = grabber.grabImageFrame(frame);
+    // a GOP longer than the interval lands on the same keyframe again, take the next one.
+    while (ret == 1 && lastPts != AV_NOPTS_VALUE && frame->best_effort_timestamp <= lastPts) {
+      ret = grabber.grabImageFrame(frame);
+    }
+    if (ret != 1) {
+      break;
+    }
+    lastPts = frame->best_effort_timestamp;
+
+    swsCtx = sws_getCachedContext(swsCtx, frame->width, frame->height,
+                                  (AVPixelFormat)frame->format, thumbWidth, thumbHeight,
+                                  AV_PIX_FMT_RGB24, SWS_AREA, nullptr, nullptr, nullptr);
+    sws_scale(swsCtx, (uint8_t const* const*)frame->data, frame->linesize, 0, frame->height,
+              thumb->data, thumb->linesize);
+
+    int64_t ptsMs = av_rescale_q(lastPts, timeBase, AVRational{1, 1000});
+    writePpm(outputPrefix + "_" + std::to_string(ptsMs) + ".ppm", thumb, thumbWidth,
+             thumbHeight);
+    count++;
+  }
+
+  sws_freeContext(swsCtx);
+  av_freep(&thumb->data[0]);
+  av_frame_free(&thumb);
+  av_frame_free(&frame);
+  grabber.close();
+
+  std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t0;
+  cout << "thumbnails extracted: " << count << ", cost=" << (diff.count() * 1000) << "ms"
+       << endl;
+}
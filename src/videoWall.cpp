@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "ffmpegUtil.h"
+
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AudioMixer.h"
+#include "Player.h"
+#include "PacketPool.h"
+#include "PlayOptions.h"
+#include "ProcessUsage.h"
+#include "VideoWall.h"
+
+extern "C" {
+#include "SDL/SDL.h"
+};
+
+namespace {
+
+using std::cout;
+using std::endl;
+
+// the wall refreshes every tile at this rate, each player shows its frame when due.
+const int WALL_REFRESH_MS = 16;
+const int WALL_WIDTH = 1920;
+const int WALL_HEIGHT = 1080;
+const Uint32 WALL_REPORT_MS = 5000;
+
+}  // namespace
+
+/*
+ * Play every file at once in one process: one window of tiles(or none, offscreen),
+ * one audio device mixing all of them, decoding on the shared executor.
+ * The players are opened in parallel, the wall ends when all are finished or closed.
+ */
+void playWall(const std::vector<string>& inputFiles, const PlayOptions& options, int cols,
+              bool offscreen) {
+  std::cout << "playWall: " << inputFiles.size() << " players, " << cols << " columns"
+            << (offscreen ? ", offscreen" : "") << std::endl;
+  ProcessUsage usage{};
+
+  if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS)) {
+    string errMsg = "Could not initialize SDL -";
+    errMsg += SDL_GetError();
+    cout << errMsg << endl;
+    throw std::runtime_error(errMsg);
+  }
+
+  int count = (int)inputFiles.size();
+  std::unique_ptr<VideoTarget> target{};
+  if (offscreen) {
+    target.reset(new OffscreenVideoWall(count));
+  } else {
+    target.reset(new SdlVideoWall(count, cols, WALL_WIDTH, WALL_HEIGHT));
+  }
+  // declared before the players, it outlives them.
+  auto mixer = AudioMixer::openOptional(!offscreen, options.audioLatencyMs);
+  PlayOptions playerOptions = options;
+  playerOptions.noAudio = mixer == nullptr;
+
+  std::vector<std::future<std::unique_ptr<Player>>> opening{};
+  std::vector<AudioSink*> sinks{};
+  for (int i = 0; i < count; i++) {
+    AudioSink* sink = mixer != nullptr ? &mixer->addInput() : nullptr;
+    sinks.push_back(sink);
+    opening.push_back(std::async(std::launch::async, [&inputFiles, &playerOptions, sink, i] {
+      return std::unique_ptr<Player>{new Player(inputFiles[i], playerOptions, sink, i)};
+    }));
+  }
+  std::vector<std::unique_ptr<Player>> players{};
+  for (int i = 0; i < count; i++) {
+    // a refused file(memory budget, nothing to play) leaves its tile empty, the rest play.
+    try {
+      players.push_back(opening[i].get());
+    } catch (const std::runtime_error& e) {
+      cout << "WARN: wall tile " << i << " left empty: " << e.what() << endl;
+      if (mixer != nullptr) {
+        mixer->removeInput(sinks[i]);
+      }
+    }
+  }
+
+  bool quit = false;
+  bool paused = false;
+  Uint32 lastReport = SDL_GetTicks();
+  while (!quit) {
+    Uint32 tickStart = SDL_GetTicks();
+    SDL_Event event;
+    // paused, nothing is due: sleep on the events instead of ticking.
+    bool got = paused ? SDL_WaitEvent(&event) : SDL_PollEvent(&event);
+    while (got) {
+      if (event.type == SDL_QUIT) {
+        cout << "SDL wall got a SDL_QUIT." << endl;
+        quit = true;
+      } else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE) {
+        paused = !paused;
+        for (auto& p : players) {
+          p->setPaused(paused);
+        }
+        cout << (paused ? "pause" : "resume") << endl;
+      }
+      got = SDL_PollEvent(&event);
+    }
+    if (quit) {
+      break;
+    }
+    if (paused) {
+      continue;
+    }
+
+    bool allFinished = true;
+    bool shown = false;
+    for (auto& p : players) {
+      shown = p->refresh(*target) || shown;
+      allFinished = allFinished && p->isFinished();
+    }
+    if (shown) {
+      target->present();
+    }
+    if (allFinished) {
+      break;
+    }
+
+    if (SDL_GetTicks() - lastReport >= WALL_REPORT_MS) {
+      lastReport = SDL_GetTicks();
+      for (auto& p : players) {
+        p->printStats();
+      }
+      target->printStats();
+      MemoryBudget::shared().printUsage();
+      LockStats::shared().printUsage();
+    }
+    Uint32 spent = SDL_GetTicks() - tickStart;
+    if (spent < (Uint32)WALL_REFRESH_MS) {
+      SDL_Delay(WALL_REFRESH_MS - spent);
+    }
+  }
+
+  for (auto& p : players) {
+    p->printStats();
+  }
+  target->printStats();
+  // detach from the mixer and tear down, all pipelines at once.
+  players.clear();
+  int64_t clipped = mixer != nullptr ? mixer->getClippedSamples() : 0;
+  cout << "wall closed, clipped samples=" << clipped << endl;
+  usage.print("wall");
+  PacketPool::shared().printStats();
+}
@@ -0,0 +1,334 @@
+#include "ffmpegUtil.h"
+#include "PeakFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace {
+
+using namespace ffmpegUtil;
+
+// the finest level has 256 frames per bin, every coarser level 4 times as many.
+const int BASE_FRAMES_PER_BIN = 256;
+const int LEVEL_FACTOR = 4;
+const int MAX_LEVELS = 8;
+// decoded before a range start and dropped, decoders need a few frames after a seek.
+const int64_t PREROLL_MS = 500;
+// short ranges keep all threads busy to the end, when some parts decode slower.
+const int RANGES_PER_THREAD = 4;
+
+struct BinAcc {
+  int64_t sumSq = 0;
+  uint32_t count = 0;
+  int16_t min = INT16_MAX;
+  int16_t max = INT16_MIN;
+
+  void add(int16_t v) {
+    min = std::min(min, v);
+    max = std::max(max, v);
+    sumSq += (int32_t)v * v;
+    count++;
+  }
+
+  void merge(const BinAcc& o) {
+    min = std::min(min, o.min);
+    max = std::max(max, o.max);
+    sumSq += o.sumSq;
+    count += o.count;
+  }
+
+  PeakBin toBin() const {
+    if (count == 0) {
+      return PeakBin{0, 0, 0};
+    }
+    return PeakBin{min, max, (int16_t)std::lrint(std::sqrt((double)sumSq / count))};
+  }
+};
+
+/*
+ * One worker: its own demuxer, decoder and resampler, summarizes one range after another.
+ * The audio is converted to S16 at its own rate, more than 2 channels are mixed to stereo.
+ */
+class RangeSummarizer {
+  PacketGrabber grabber;
+  AVCodecContext* codecCtx = nullptr;
+  std::unique_ptr<ReSampler> reSampler{};
+  int audioIndex = -1;
+  AVRational timeBase{1, 1};
+  int64_t startPts = 0;
+  AudioInfo out{};
+
+  AVPacket* packet = av_packet_alloc();
+  AVFrame* frame = av_frame_alloc();
+  uint8_t* outData = nullptr;
+  int outSize = 0;
+  // where the next frame starts when it comes without a timestamp.
+  int64_t nextPos = 0;
+
+  /*
+   *  return
+   *          true   : the frame reached the end of the range
+   */
+  bool consume(int64_t first, int64_t last, std::vector<BinAcc>& bins) {
+    int64_t ts = frame->best_effort_timestamp;
+    int64_t pos = ts != AV_NOPTS_VALUE
+                      ? av_rescale_q(ts - startPts, timeBase, AVRational{1, out.sampleRate})
+                      : nextPos;
+    outSize = reSampler->ensureDataBuf(&outData, outSize, frame->nb_samples);
+    int samples, bytes;
+    std::tie(samples, bytes) = reSampler->reSample(outData, outSize, frame);
+    nextPos = pos + samples;
+
+    const int16_t* s = (const int16_t*)outData;
+    int ch = out.channels;
+    for (int i = 0; i < samples; i++) {
+      int64_t p = pos + i;
+      if (p < first) {
+        continue;
+      }
+      if (p >= last) {
+        return true;
+      }
+      size_t bin = (size_t)((p - first) / BASE_FRAMES_PER_BIN);
+      if (bins.size() < (bin + 1) * ch) {
+        bins.resize((bin + 1) * ch);
+      }
+      for (int c = 0; c < ch; c++) {
+        bins[bin * ch + c].add(s[i * ch + c]);
+      }
+    }
+    return false;
+  }
+
+ public:
+  RangeSummarizer(const string& inputPath) : grabber(inputPath) {
+    audioIndex = grabber.getAudioIndex();
+    if (audioIndex < 0) {
+      throw std::runtime_error("waveform: no audio stream in " + inputPath);
+    }
+    auto formatCtx = grabber.getFormatCtx();
+    // only the audio is demuxed.
+    for (unsigned int i = 0; i < formatCtx->nb_streams; i++) {
+      if ((int)i != audioIndex) {
+        formatCtx->streams[i]->discard = AVDISCARD_ALL;
+      }
+    }
+    auto stream = formatCtx->streams[audioIndex];
+    timeBase = stream->time_base;
+    startPts = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+    ffUtils::initCodecContext(formatCtx, audioIndex, &codecCtx);
+    int64_t layout = codecCtx->channel_layout > 0
+                         ? (int64_t)codecCtx->channel_layout
+                         : av_get_default_channel_layout(codecCtx->channels);
+    AudioInfo in(layout, codecCtx->sample_rate, codecCtx->channels, codecCtx->sample_fmt);
+    int channels = std::min(codecCtx->channels, 2);
+    out = AudioInfo(channels == 1 ? AV_CH_LAYOUT_MONO : AV_CH_LAYOUT_STEREO,
+                    codecCtx->sample_rate, channels, AV_SAMPLE_FMT_S16);
+    reSampler.reset(new ReSampler(in, out));
+  }
+
+  RangeSummarizer(const RangeSummarizer&) = delete;
+  RangeSummarizer& operator=(const RangeSummarizer&) = delete;
+
+  ~RangeSummarizer() {
+    if (outData != nullptr) {
+      av_freep(&outData);
+    }
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&codecCtx);
+  }
+
+  int getSampleRate() const { return out.sampleRate; }
+  int getChannels() const { return out.channels; }
+
+  /*
+   * bins of frames [first, last), first is a multiple of the bin size.
+   */
+  std::vector<BinAcc> summarize(int64_t first, int64_t last) {
+    std::vector<BinAcc> bins{};
+    int64_t seekMs = std::max((int64_t)0, first * 1000 / out.sampleRate - PREROLL_MS);
+    grabber.seekToTimestamp(audioIndex,
+                            startPts + av_rescale_q(seekMs, AVRational{1, 1000}, timeBase));
+    avcodec_flush_buffers(codecCtx);
+    nextPos = av_rescale(seekMs, out.sampleRate, 1000);
+
+    bool done = false;
+    while (!done) {
+      int index = grabber.grabPacket(packet);
+      if (index < 0) {
+        // file end, drain the decoder.
+        avcodec_send_packet(codecCtx, nullptr);
+        while (!done && avcodec_receive_frame(codecCtx, frame) == 0) {
+          done = consume(first, last, bins);
+        }
+        break;
+      }
+      if (index == audioIndex && avcodec_send_packet(codecCtx, packet) == 0) {
+        while (!done && avcodec_receive_frame(codecCtx, frame) == 0) {
+          done = consume(first, last, bins);
+        }
+      }
+      av_packet_unref(packet);
+    }
+    return bins;
+  }
+};
+
+/*
+ * every level from the finest bins, each bin of a level merges LEVEL_FACTOR bins below.
+ */
+std::vector<PeakFile::Level> buildLevels(const std::vector<BinAcc>& base, int channels) {
+  std::vector<PeakFile::Level> levels{};
+  std::vector<BinAcc> current = base;
+  uint32_t framesPerBin = BASE_FRAMES_PER_BIN;
+  while (true) {
+    PeakFile::Level level{framesPerBin, {}};
+    level.bins.reserve(current.size());
+    for (auto& b : current) {
+      level.bins.push_back(b.toBin());
+    }
+    levels.push_back(std::move(level));
+
+    size_t binCount = current.size() / channels;
+    if (binCount <= 1 || (int)levels.size() >= MAX_LEVELS) {
+      break;
+    }
+    size_t coarseCount = (binCount + LEVEL_FACTOR - 1) / LEVEL_FACTOR;
+    std::vector<BinAcc> coarse(coarseCount * channels);
+    for (size_t i = 0; i < binCount; i++) {
+      for (int c = 0; c < channels; c++) {
+        coarse[(i / LEVEL_FACTOR) * channels + c].merge(current[i * channels + c]);
+      }
+    }
+    current.swap(coarse);
+    framesPerBin *= LEVEL_FACTOR;
+  }
+  return levels;
+}
+
+}  // namespace
+
+/*
+ * Write '<inputPath>.lpwf', min/max/RMS of the audio at several zoom levels.
+ *
+ * The file is split into ranges of whole bins. Every thread opens the file itself and
+ * takes the next range: it seeks a bit before the range start, decodes and drops up to
+ * the start, and summarizes until the range end. Ranges never share a bin, so the results
+ * are copied together without any merging.
+ */
+void buildWaveform(const string& inputPath, int threads) {
+  auto t0 = std::chrono::steady_clock::now();
+
+  // probe once for the layout of the job.
+  RangeSummarizer probe{inputPath};
+  int sampleRate = probe.getSampleRate();
+  int channels = probe.getChannels();
+  int64_t inputSize = -1;
+  int64_t totalFrames = -1;
+  {
+    PacketGrabber grabber{inputPath};
+    auto formatCtx = grabber.getFormatCtx();
+    if (formatCtx->pb != nullptr) {
+      inputSize = (int64_t)avio_size(formatCtx->pb);
+    }
+    if (formatCtx->duration != AV_NOPTS_VALUE && formatCtx->duration > 0) {
+      totalFrames = av_rescale(formatCtx->duration, sampleRate, AV_TIME_BASE);
+    }
+  }
+
+  if (threads <= 0) {
+    threads = std::max(1, (int)std::thread::hardware_concurrency());
+  }
+  // without a duration there is nothing to split, one range to the end.
+  int rangeCount = totalFrames > 0 ? threads * RANGES_PER_THREAD : 1;
+  int64_t rangeFrames = totalFrames > 0 ? (totalFrames + rangeCount - 1) / rangeCount : 0;
+  rangeFrames = (rangeFrames + BASE_FRAMES_PER_BIN - 1) / BASE_FRAMES_PER_BIN *
+                BASE_FRAMES_PER_BIN;
+  threads = std::min(threads, rangeCount);
+  cout << "waveform: rate=" << sampleRate << ", channels=" << channels
+       << ", frames=" << totalFrames << ", ranges=" << rangeCount << ", threads=" << threads
+       << endl;
+
+  std::vector<BinAcc> base{};
+  std::mutex baseMutex{};
+  std::atomic<int> nextRange{0};
+  std::exception_ptr error{};
+
+  auto worker = [&](RangeSummarizer* summarizer) {
+    try {
+      std::unique_ptr<RangeSummarizer> own{};
+      if (summarizer == nullptr) {
+        own.reset(new RangeSummarizer(inputPath));
+        summarizer = own.get();
+      }
+      int r;
+      while ((r = nextRange++) < rangeCount) {
+        int64_t first = r * rangeFrames;
+        int64_t last = r == rangeCount - 1 ? INT64_MAX : first + rangeFrames;
+        auto bins = summarizer->summarize(first, last);
+
+        std::lock_guard<std::mutex> lg{baseMutex};
+        size_t offset = (size_t)(first / BASE_FRAMES_PER_BIN) * channels;
+        if (base.size() < offset + bins.size()) {
+          base.resize(offset + bins.size());
+        }
+        std::copy(bins.begin(), bins.end(), base.begin() + offset);
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lg{baseMutex};
+      error = std::current_exception();
+      nextRange = rangeCount;
+    }
+  };
+
+  std::vector<std::thread> workers{};
+  for (int t = 1; t < threads; t++) {
+    workers.emplace_back(worker, nullptr);
+  }
+  // the probe is a worker as well.
+  worker(&probe);
+  for (auto& w : workers) {
+    w.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  // the real length, the duration of the container is only an estimate.
+  size_t binCount = base.size() / channels;
+  while (binCount > 0 && base[(binCount - 1) * channels].count == 0) {
+    binCount--;
+  }
+  base.resize(binCount * channels);
+  totalFrames = binCount > 0 ? (int64_t)(binCount - 1) * BASE_FRAMES_PER_BIN +
+                                   base[(binCount - 1) * channels].count
+                             : 0;
+
+  auto levels = buildLevels(base, channels);
+  auto outputPath = PeakFile::sidecarPath(inputPath);
+  if (!PeakFile::save(outputPath, sampleRate, channels, inputSize, totalFrames, levels)) {
+    throw std::runtime_error("can not save peak file: " + outputPath);
+  }
+
+  std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t0;
+  double audioSeconds = (double)totalFrames / sampleRate;
+  cout << "peak file saved: " << outputPath << ", levels=" << levels.size()
+       << ", audio=" << audioSeconds << "s, cost=" << (diff.count() * 1000) << "ms, x"
+       << (audioSeconds / diff.count()) << " realtime" << endl;
+}
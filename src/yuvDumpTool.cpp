@@ -0,0 +1,72 @@
+#include "ffmpegUtil.h"
+#include "FrameWriter.h"
+#include "test/FrameGrabber.h"
+
+#include <iostream>
+#include <string>
+#include <chrono>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+/*
+ * Decode all video frames of inputPath into a raw yuv420p file, or a Y4M file when
+ * outputPath ends with '.y4m'.
+ */
+void dumpYuv(const string& inputPath, const string& outputPath, bool directIo) {
+  using namespace ffmpegUtil;
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  FrameGrabber grabber{inputPath, true, false};
+  grabber.start();
+
+  int width = grabber.getWidth();
+  int height = grabber.getHeight();
+  AVRational frameRate =
+      av_guess_frame_rate(grabber.getFormatCtx(),
+                          grabber.getFormatCtx()->streams[grabber.getVideoIndex()], nullptr);
+
+  YuvWriterOptions options{};
+  options.y4m =
+      outputPath.size() > 4 && outputPath.compare(outputPath.size() - 4, 4, ".y4m") == 0;
+  options.directIo = directIo;
+  YuvFrameWriter writer{outputPath, width, height, frameRate, options};
+
+  AVFrame* frame = av_frame_alloc();
+  AVFrame* yuv = nullptr;
+  struct SwsContext* swsCtx = nullptr;
+
+  while (grabber.grabImageFrame(frame) == 1) {
+    if (frame->format == AV_PIX_FMT_YUV420P) {
+      writer.writeFrame(frame);
+      continue;
+    }
+    // other pixel formats are converted first.
+    if (yuv == nullptr) {
+      yuv = av_frame_alloc();
+      av_image_alloc(yuv->data, yuv->linesize, width, height, AV_PIX_FMT_YUV420P, 32);
+    }
+    swsCtx = sws_getCachedContext(swsCtx, frame->width, frame->height,
+                                  (AVPixelFormat)frame->format, width, height,
+                                  AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    sws_scale(swsCtx, (uint8_t const* const*)frame->data, frame->linesize, 0, frame->height,
+              yuv->data, yuv->linesize);
+    writer.writeFrame(yuv);
+  }
+
+  bool ok = writer.close();
+
+  if (yuv != nullptr) {
+    av_freep(&yuv->data[0]);
+    av_frame_free(&yuv);
+  }
+  sws_freeContext(swsCtx);
+  av_frame_free(&frame);
+  grabber.close();
+
+  std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t0;
+  cout << "dump " << (ok ? "finished" : "FAILED") << ": frames=" << writer.getFramesWritten()
+       << ", cost=" << (diff.count() * 1000) << "ms" << endl;
+}
@@ -0,0 +1,77 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include "AudioGain.h"
+
+using std::cout;
+using std::endl;
+
+namespace {
+using namespace ffmpegUtil;
+
+/*
+ * ns per call of one gain kernel over a callback sized buffer.
+ */
+double timeKernel(const std::function<void(float, float)>& kernel, int loops) {
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loops; i++) {
+    // fade up and back down, the buffer stays in range.
+    kernel(i % 2 == 0 ? 0.8f : 1.25f, i % 2 == 0 ? 1.25f : 0.8f);
+  }
+  std::chrono::duration<double, std::nano> diff = std::chrono::steady_clock::now() - t0;
+  return diff.count() / loops;
+}
+
+}  // namespace
+
+/*
+ * Cost of the volume/fade kernels per audio callback, scalar vs the compiled SIMD kernel.
+ * One callback is 1024 stereo frames, the default buffer of the players.
+ */
+void benchAudioGain() {
+  const int frames = 1024;
+  const int channels = 2;
+  const int count = frames * channels;
+  const int loops = 200000;
+
+  std::vector<int16_t> s16(count);
+  std::vector<float> flt(count);
+  for (int i = 0; i < count; i++) {
+    s16[i] = (int16_t)((i * 7919) % 65536 - 32768);
+    flt[i] = s16[i] / 32768.0f;
+  }
+
+  cout << "benchAudioGain: " << frames << " frames x " << channels
+       << " channels per callback, simd=" << GainKernels::name() << endl;
+
+  double s16Scalar = timeKernel(
+      [&](float g0, float g1) { GainKernels::scaleS16Scalar(s16.data(), count, g0, g1); },
+      loops);
+  double s16Simd = timeKernel(
+      [&](float g0, float g1) { GainKernels::scaleS16(s16.data(), count, g0, g1); }, loops);
+  double fltScalar = timeKernel(
+      [&](float g0, float g1) { GainKernels::scaleFltScalar(flt.data(), count, g0, g1); },
+      loops);
+  double fltSimd = timeKernel(
+      [&](float g0, float g1) { GainKernels::scaleFlt(flt.data(), count, g0, g1); }, loops);
+
+  cout << "  s16 scalar: " << s16Scalar << " ns/callback" << endl;
+  cout << "  s16 " << GainKernels::name() << ": " << s16Simd << " ns/callback, x"
+       << (s16Scalar / s16Simd) << endl;
+  cout << "  flt scalar: " << fltScalar << " ns/callback" << endl;
+  cout << "  flt " << GainKernels::name() << ": " << fltSimd << " ns/callback, x"
+       << (fltScalar / fltSimd) << endl;
+
+  // the simd kernels must match the scalar ones, up to rounding.
+  std::vector<int16_t> a(s16), b(s16);
+  GainKernels::scaleS16Scalar(a.data(), count, 0.3f, 1.7f);
+  GainKernels::scaleS16(b.data(), count, 0.3f, 1.7f);
+  int maxDiff = 0;
+  for (int i = 0; i < count; i++) {
+    maxDiff = std::max(maxDiff, std::abs(a[i] - b[i]));
+  }
+  cout << "  s16 max diff to scalar: " << maxDiff << endl;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include "AudioGain.h"
+#include "AudioMeter.h"
+
+using std::cout;
+using std::endl;
+
+/*
+ * Cost of metering 48kHz stereo S16, as a share of one core, scalar vs the simd kernel.
+ * Also checks the loudness of a -20dBFS 997Hz stereo sine, which must read -20 LUFS.
+ */
+void benchAudioMeter() {
+  using namespace ffmpegUtil;
+  const int rate = 48000;
+  const int channels = 2;
+  const int frames = rate * 10;
+
+  std::vector<int16_t> s16((size_t)frames * channels);
+  for (int f = 0; f < frames; f++) {
+    double v = 0.1 * std::sin(2 * 3.14159265358979 * 997 * f / rate);
+    s16[f * channels] = s16[f * channels + 1] = (int16_t)lrint(v * 32767);
+  }
+
+  AudioMeter meter{};
+  meter.configure(channels, rate);
+  const int callback = 1024;
+  const int loops = 20;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loops; i++) {
+    for (int f = 0; f + callback <= frames; f += callback) {
+      meter.process((const uint8_t*)&s16[f * channels], callback, AV_SAMPLE_FMT_S16);
+    }
+  }
+  std::chrono::duration<double> diff = std::chrono::steady_clock::now() - t0;
+  double audioSeconds = (double)frames / rate * loops;
+
+  MeterReading r{};
+  meter.read(r);
+  cout << "benchAudioMeter: simd=" << GainKernels::name() << ", "
+       << (diff.count() / audioSeconds * 100) << "% of a core at 48kHz stereo" << endl;
+  cout << "  short-term=" << r.shortTermLufs << "LUFS(expect -20), peak=" << r.peakDb[0]
+       << "dB(expect -20), rms=" << r.rmsDb[0] << "dB(expect -23)" << endl;
+
+  // the same block through the scalar kernel.
+  MeterKernels::Biquad shelf{}, highPass{};
+  MeterKernels::kWeighting(rate, shelf, highPass);
+  std::vector<float> block((size_t)callback * MeterKernels::LANES);
+  for (int f = 0; f < callback; f++) {
+    block[f * 4] = block[f * 4 + 1] = s16[f * channels] / 32768.0f;
+  }
+  MeterKernels::Lanes a{}, b{};
+  t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < 2000; i++) {
+    MeterKernels::runScalar(block.data(), callback, shelf, highPass, a);
+  }
+  std::chrono::duration<double, std::nano> scalar = std::chrono::steady_clock::now() - t0;
+  t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < 2000; i++) {
+    MeterKernels::run(block.data(), callback, shelf, highPass, b);
+  }
+  std::chrono::duration<double, std::nano> simd = std::chrono::steady_clock::now() - t0;
+  cout << "  kernel scalar: " << scalar.count() / 2000 << " ns/callback, "
+       << GainKernels::name() << ": " << simd.count() / 2000 << " ns/callback, K-weighted diff="
+       << std::fabs(a.acc[2][0] - b.acc[2][0]) / a.acc[2][0] << endl;
+}
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include "ffmpegUtil.h"
+#include "AudioGain.h"
+
+using std::cout;
+using std::endl;
+
+namespace {
+using namespace ffmpegUtil;
+
+/*
+ * ns per 1024 frame input frame of one way to downmix.
+ */
+double timeDownmix(ReSampler& reSampler, const AVFrame* frame, int loops) {
+  uint8_t* outData = nullptr;
+  int outSize = reSampler.allocDataBuf(&outData, frame->nb_samples);
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < loops; i++) {
+    reSampler.reSample(outData, outSize, frame);
+  }
+  std::chrono::duration<double, std::nano> diff = std::chrono::steady_clock::now() - t0;
+  av_freep(&outData);
+  return diff.count() / loops;
+}
+
+}  // namespace
+
+/*
+ * 7.1 planar float to stereo float at 48kHz: swr's generic path, swr with a cached
+ * ITU matrix, and the downmix kernel that replaces swr for this case.
+ */
+void benchDownmix() {
+  const int rate = 48000;
+  const int frames = 1024;
+  const int loops = 20000;
+  const int64_t inLayout = AV_CH_LAYOUT_7POINT1;
+  AudioInfo in(inLayout, rate, 8, AV_SAMPLE_FMT_FLTP);
+  AudioInfo out(AV_CH_LAYOUT_STEREO, rate, 2, AV_SAMPLE_FMT_FLT);
+
+  AVFrame* frame = av_frame_alloc();
+  frame->nb_samples = frames;
+  frame->format = AV_SAMPLE_FMT_FLTP;
+  frame->channel_layout = inLayout;
+  frame->channels = 8;
+  frame->sample_rate = rate;
+  av_frame_get_buffer(frame, 0);
+  for (int c = 0; c < 8; c++) {
+    float* plane = (float*)frame->extended_data[c];
+    for (int f = 0; f < frames; f++) {
+      plane[f] = 0.5f * (float)std::sin(2 * 3.14159265358979 * (220 * (c + 1)) * f / rate);
+    }
+  }
+
+  auto matrix = DownmixMatrix::get("itu", inLayout, AV_CH_LAYOUT_STEREO);
+  ReSampler generic(in, out);
+  ReSampler swrMatrix(in, out, matrix, false);
+  ReSampler kernel(in, out, matrix);
+
+  double genericNs = timeDownmix(generic, frame, loops);
+  double swrMatrixNs = timeDownmix(swrMatrix, frame, loops);
+  double kernelNs = timeDownmix(kernel, frame, loops);
+
+  cout << "benchDownmix: 7.1 fltp -> stereo, " << frames << " frames per call, simd="
+       << GainKernels::name() << endl;
+  cout << "  swr generic:    " << genericNs << " ns" << endl;
+  cout << "  swr itu matrix: " << swrMatrixNs << " ns" << endl;
+  cout << "  kernel " << kernel.describeDownmix() << ": " << kernelNs << " ns, x"
+       << (genericNs / kernelNs) << " vs swr generic" << endl;
+
+  av_frame_free(&frame);
+}
@@ -0,0 +1,36 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "PlayOptions.h"
+#include "TaskExecutor.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+extern void playWall(const std::vector<string>& inputPaths, const PlayOptions& options,
+                     int cols, bool offscreen);
+extern void playCooperative(const std::vector<string>& inputPaths, const PlayOptions& options,
+                            int cols, bool offscreen);
+
+/*
+ * copies of one file played offscreen in real time, by the threaded pipeline(reader
+ * thread, executor workers) or the cooperative one. Both print wall time, cpu time and
+ * context switches of the process at the end. The executor is chosen once per process,
+ * so run it twice, within the same limits, e.g.
+ *   taskset -c 0 ./runTest --bench-pipeline a.mp4 4 threaded      (1 core)
+ *   taskset -c 0 ./runTest --bench-pipeline a.mp4 4 cooperative
+ *   systemd-run --scope -p CPUQuota=150% ./runTest --bench-pipeline a.mp4 4 cooperative
+ */
+void benchPipeline(const string& inputPath, int copies, bool cooperative) {
+  std::vector<string> files(copies, inputPath);
+  PlayOptions options{};
+  cout << "benchPipeline: " << copies << " x " << inputPath << ", "
+       << (cooperative ? "cooperative" : "threaded") << endl;
+  if (cooperative) {
+    TaskExecutor::configureShared(TaskExecutor::COOPERATIVE);
+    playCooperative(files, options, 1, true);
+  } else {
+    playWall(files, options, 1, true);
+  }
+}
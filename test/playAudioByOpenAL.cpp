@@ -56,11 +56,7 @@ void feedAudioData(FrameGrabber* grabber, ffmpegUtil::ReSampler* reSampler, ALui
   int ret = grabber->grabAudioFrame(aFrame);
   if (ret == 2) {
     // cout << "play with ReSampler!" << endl;
-    if (outBuffer == nullptr) {
-      outBufferSize = reSampler->allocDataBuf(&outBuffer, aFrame->nb_samples);
-    } else {
-      memset(outBuffer, 0, outBufferSize);
-    }
+    outBufferSize = reSampler->ensureDataBuf(&outBuffer, outBufferSize, aFrame->nb_samples);
 
     int outSamples;
     int outDataSize;
@@ -34,11 +34,9 @@ void audio_callback(void* userdata, Uint8* stream, int len) {
    if (ret == 2) {
     // cout << "play with ReSampler!" << endl;
     if (outBuffer == nullptr) {
-      outBufferSize = reSampler->allocDataBuf(&outBuffer, aFrame->nb_samples);
       cout << " --------- audio samples: " << aFrame->nb_samples << endl;
-    } else {
-      memset(outBuffer, 0, outBufferSize);
     }
+    outBufferSize = reSampler->ensureDataBuf(&outBuffer, outBufferSize, aFrame->nb_samples);
 
     int outSamples;
     int outDataSize;
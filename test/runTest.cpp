@@ -1,8 +1,11 @@
 #include <iostream>
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 //#include "FrameGrabber.h"
 #include "ffmpegUtil.h"
 #include "test/FrameGrabber.h"
+#include "PlayOptions.h"
 
 
 using std::string;
@@ -17,7 +20,14 @@ namespace ffmpegUtil {
 extern void playVideo(const string& inputPath);
 extern void playAudioBySDL(const string& inputPath);
 extern void playAudioByOpenAL(const string& inputPath);
-extern void playVideoWithAudio(const string& inputPath);
+extern void playVideoWithAudio(const string& inputPath, const PlayOptions& options);
+extern void benchAudioGain();
+extern void benchAudioMeter();
+extern void benchDownmix();
+extern void benchPipeline(const string& inputPath, int copies, bool cooperative);
+extern int testDownmix();
+extern int testPeakFile();
+extern int testKeyframeIndex();
 
 void testReadFileInfo() {
   using namespace ffmpegUtil;
@@ -95,17 +105,32 @@ void testPlayVideoWithAudio() {
   //string inputPath = "D:/data/video/v1_out10.mp4";
   //string inputPath = "D:/data/video/p3_out1.mp4";
   string inputPath = "D:/data/video/2019-08-15_16-39-54.mp4";
-  playVideoWithAudio(inputPath);
+  playVideoWithAudio(inputPath, PlayOptions{});
 }
 
 
 
 int main0(int argc, char* argv[]) {
   cout << "hello, little player." << endl;
+  // runTest --bench-pipeline <media file> [copies] [threaded|cooperative]
+  if (argc >= 3 && string(argv[1]) == "--bench-pipeline") {
+    int copies = argc >= 4 ? std::max(1, std::atoi(argv[3])) : 4;
+    bool cooperative = argc >= 5 && string(argv[4]) == "cooperative";
+    benchPipeline(argv[2], copies, cooperative);
+    return 0;
+  }
+  // checks of the pure parts, no media file needed.
+  int failed = testDownmix();
+  failed += testPeakFile();
+  failed += testKeyframeIndex();
+  cout << "failed checks: " << failed << endl;
   //testReadFileInfo();
   //testPlayVideo();
   //testPlayAudio();
   testPlayVideoWithAudio();
+  //benchAudioGain();
+  //benchAudioMeter();
+  //benchDownmix();
 
   return 0;
 }
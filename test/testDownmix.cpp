@@ -0,0 +1,137 @@
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "DownmixMatrix.h"
+
+using std::cout;
+using std::endl;
+
+namespace {
+using namespace ffmpegUtil;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    failures++;
+    cout << "FAIL: " << what << endl;
+  }
+}
+
+// column of a channel in the matrix, the channel order of FFmpeg.
+int columnOf(int64_t layout, uint64_t channel) {
+  return av_get_channel_layout_nb_channels(layout & (channel - 1));
+}
+
+void checkPreset(const std::string& mode, int64_t inLayout, int64_t outLayout) {
+  auto m = DownmixMatrix::get(mode, inLayout, outLayout);
+  std::string name = mode + " " + std::to_string(av_get_channel_layout_nb_channels(inLayout)) +
+                     "->" + std::to_string(av_get_channel_layout_nb_channels(outLayout));
+  check(m != nullptr, name + ": no matrix");
+  if (m == nullptr) {
+    return;
+  }
+  int inChannels = av_get_channel_layout_nb_channels(inLayout);
+  int outChannels = av_get_channel_layout_nb_channels(outLayout);
+  check(m->inChannels == inChannels, name + ": in channels");
+  check(m->outChannels == outChannels, name + ": out channels");
+  for (int o = 0; o < m->outChannels; o++) {
+    double sum = 0;
+    for (int i = 0; i < m->inChannels; i++) {
+      sum += std::fabs(m->at(o, i));
+    }
+    // no output can clip.
+    check(sum <= 1.0 + 1e-9, name + ": row " + std::to_string(o) + " sums to " +
+                                 std::to_string(sum));
+    if (inLayout & AV_CH_LOW_FREQUENCY) {
+      check(m->at(o, columnOf(inLayout, AV_CH_LOW_FREQUENCY)) == 0.0, name + ": LFE mixed in");
+    }
+  }
+  check(DownmixMatrix::get(mode, inLayout, outLayout) == m, name + ": not cached");
+}
+
+bool customThrows(const std::string& mode) {
+  try {
+    DownmixMatrix::get(mode, AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_STEREO);
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+void checkCustom() {
+  auto m = DownmixMatrix::get("1,0,0.7,0,0.7,0;0,1,0.7,0,0,0.7", AV_CH_LAYOUT_5POINT1,
+                              AV_CH_LAYOUT_STEREO);
+  check(m != nullptr, "custom: no matrix");
+  if (m != nullptr) {
+    // a custom matrix is taken as is, not normalized.
+    check(m->at(0, 0) == 1.0 && m->at(0, 2) == 0.7 && m->at(1, 5) == 0.7 && m->at(1, 4) == 0,
+          "custom: wrong coefficients");
+  }
+  check(customThrows("1,0,0,0,0,0"), "custom: a missing row is taken");
+  check(customThrows("1,0,0,0,0;0,1,0,0,0,0"), "custom: a short row is taken");
+  check(customThrows("1,0,0,0,0,0,0;0,1,0,0,0,0"), "custom: a long row is taken");
+  check(customThrows("1,0,0,0,0,0;0,1,0,0,0,0;0,0,1,0,0,0"), "custom: an extra row is taken");
+
+  check(DownmixMatrix::get("", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_STEREO) == nullptr,
+        "empty mode: not swr's default");
+  check(DownmixMatrix::get("default", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_STEREO) == nullptr,
+        "default mode: not swr's default");
+  check(DownmixMatrix::get("itu", AV_CH_LAYOUT_STEREO, AV_CH_LAYOUT_5POINT1) == nullptr,
+        "itu: an upmix got a matrix");
+}
+
+// the simd kernel against the scalar one, odd frame counts reach the scalar tail too.
+void checkKernel(int inCh, int outCh, int frames) {
+  std::vector<std::vector<float>> planes(inCh, std::vector<float>(frames));
+  std::vector<const float*> in(inCh);
+  std::srand(inCh * 100 + outCh);
+  for (int c = 0; c < inCh; c++) {
+    for (auto& s : planes[c]) {
+      s = (float)std::rand() / RAND_MAX * 2.0f - 1.0f;
+    }
+    in[c] = planes[c].data();
+  }
+  std::vector<float> m(inCh * outCh);
+  for (auto& c : m) {
+    c = (float)std::rand() / RAND_MAX - 0.5f;
+  }
+  std::vector<float> simd(frames * outCh), scalar(frames * outCh);
+  DownmixKernels::mix(in.data(), inCh, frames, simd.data(), outCh, m.data());
+  DownmixKernels::mixScalar(in.data(), inCh, frames, scalar.data(), outCh, m.data());
+  check(std::memcmp(simd.data(), scalar.data(), simd.size() * sizeof(float)) == 0,
+        "kernel " + std::to_string(inCh) + "->" + std::to_string(outCh) + " x" +
+            std::to_string(frames) + ": simd differs from scalar");
+}
+
+}  // namespace
+
+/*
+ * DownmixMatrix presets and parsing, and the downmix kernel against its scalar version.
+ *  return
+ *          the number of failed checks
+ */
+int testDownmix() {
+  failures = 0;
+  checkPreset("itu", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_STEREO);
+  checkPreset("dolby", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_STEREO);
+  checkPreset("itu", AV_CH_LAYOUT_5POINT1_BACK, AV_CH_LAYOUT_STEREO);
+  checkPreset("itu", AV_CH_LAYOUT_7POINT1, AV_CH_LAYOUT_STEREO);
+  checkPreset("dolby", AV_CH_LAYOUT_7POINT1, AV_CH_LAYOUT_STEREO);
+  checkPreset("itu", AV_CH_LAYOUT_5POINT1, AV_CH_LAYOUT_MONO);
+  checkCustom();
+  for (int inCh : {3, 6, 8}) {
+    for (int outCh : {1, 2}) {
+      for (int frames : {1, 7, 1024, 1027}) {
+        checkKernel(inCh, outCh, frames);
+      }
+    }
+  }
+  cout << "testDownmix: " << (failures == 0 ? "OK" : "FAILED") << ", failures=" << failures
+       << endl;
+  return failures;
+}
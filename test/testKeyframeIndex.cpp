@@ -0,0 +1,115 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "KeyframeIndex.h"
+
+using std::cout;
+using std::endl;
+
+namespace {
+using namespace ffmpegUtil;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    failures++;
+    cout << "FAIL: " << what << endl;
+  }
+}
+
+// the first bytes of a file only, as left by an interrupted write.
+void copyPrefix(const string& from, const string& to, size_t bytes) {
+  std::ifstream is{from, std::ios::binary};
+  std::vector<char> data{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+  std::ofstream os{to, std::ios::binary | std::ios::trunc};
+  os.write(data.data(), std::min(bytes, data.size()));
+}
+
+KeyframeEntry entry(int64_t pts, int64_t pos) {
+  KeyframeEntry e{};
+  e.pts = pts;
+  e.pos = pos;
+  e.size = 1000 + (int32_t)pos;
+  e.flags = AV_PKT_FLAG_KEY;
+  return e;
+}
+
+// lookups over keyframes at pts 1000, 2000 ... 5000 in a 1/1000 time base.
+void checkLookup(const KeyframeIndex& index, const std::string& name) {
+  check(index.size() == 5, name + ": wrong keyframe count");
+  if (index.size() != 5) {
+    return;
+  }
+  for (size_t i = 1; i < index.size(); i++) {
+    check(index[i - 1].pts < index[i].pts, name + ": not sorted by pts");
+  }
+  check(index.lookup(0)->pts == 1000, name + ": before the first is not the first");
+  check(index.lookup(1000)->pts == 1000, name + ": exact first");
+  check(index.lookup(3000)->pts == 3000, name + ": exact middle");
+  check(index.lookup(3999)->pts == 3000, name + ": between is not the one before");
+  check(index.lookup(5000)->pts == 5000, name + ": exact last");
+  check(index.lookup(99999)->pts == 5000, name + ": after the last is not the last");
+  check(index.lookup(3000)->pos == 300, name + ": wrong byte position");
+  check(index.lookupMs(4500)->pts == 4000, name + ": lookupMs");
+}
+
+}  // namespace
+
+/*
+ * KeyframeIndex sorting, lookup and sidecar round trip, and the rejection of broken sidecars.
+ *  return
+ *          the number of failed checks
+ */
+int testKeyframeIndex() {
+  failures = 0;
+  const string path = "testKeyframeIndex.kfi";
+  const string cut = "testKeyframeIndex.cut.kfi";
+
+  // keyframes in dts order, which need not be pts order.
+  std::vector<KeyframeEntry> keyframes{entry(1000, 100), entry(3000, 300), entry(2000, 200),
+                                       entry(4000, 400), entry(5000, 500)};
+  auto built = KeyframeIndex::fromEntries(0, AVRational{1, 1000}, 123456, keyframes);
+  checkLookup(*built, "built");
+
+  auto empty = KeyframeIndex::fromEntries(0, AVRational{1, 1000}, 0, {});
+  check(empty->lookup(1000) == nullptr && empty->lookupMs(0) == nullptr,
+        "empty: lookup found a keyframe");
+
+  check(built->save(path), "save failed");
+  {
+    // a null format context skips the stale check.
+    auto loaded = KeyframeIndex::load(path, nullptr);
+    check(loaded != nullptr, "round trip: not loaded");
+    if (loaded != nullptr) {
+      check(loaded->getStreamIndex() == 0 && loaded->getTimeBase().num == 1 &&
+                loaded->getTimeBase().den == 1000,
+            "round trip: header differs");
+      checkLookup(*loaded, "loaded");
+    }
+  }
+
+  check(KeyframeIndex::load("testKeyframeIndex.missing.kfi", nullptr) == nullptr,
+        "a missing file is taken");
+  copyPrefix(path, cut, sizeof(KeyframeIndexHeader) + sizeof(KeyframeEntry) * 5 - 1);
+  check(KeyframeIndex::load(cut, nullptr) == nullptr, "a file without its last byte is taken");
+  copyPrefix(path, cut, sizeof(KeyframeIndexHeader) - 1);
+  check(KeyframeIndex::load(cut, nullptr) == nullptr, "a file without its header is taken");
+
+  {
+    std::ofstream os{cut, std::ios::binary | std::ios::trunc};
+    std::vector<char> junk(sizeof(KeyframeIndexHeader) + sizeof(KeyframeEntry) * 5, 'x');
+    os.write(junk.data(), junk.size());
+  }
+  check(KeyframeIndex::load(cut, nullptr) == nullptr, "a file of another format is taken");
+
+  std::remove(path.c_str());
+  std::remove(cut.c_str());
+  cout << "testKeyframeIndex: " << (failures == 0 ? "OK" : "FAILED")
+       << ", failures=" << failures << endl;
+  return failures;
+}
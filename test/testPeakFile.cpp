@@ -0,0 +1,113 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "PeakFile.h"
+
+using std::cout;
+using std::endl;
+
+namespace {
+using namespace ffmpegUtil;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    failures++;
+    cout << "FAIL: " << what << endl;
+  }
+}
+
+// the first bytes of a file only, as left by an interrupted write.
+void copyPrefix(const string& from, const string& to, size_t bytes) {
+  std::ifstream is{from, std::ios::binary};
+  std::vector<char> data{std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+  std::ofstream os{to, std::ios::binary | std::ios::trunc};
+  os.write(data.data(), std::min(bytes, data.size()));
+}
+
+size_t fileSize(const string& path) {
+  std::ifstream is{path, std::ios::binary | std::ios::ate};
+  return (size_t)is.tellg();
+}
+
+}  // namespace
+
+/*
+ * PeakFile save/load round trip, and the rejection of truncated, stale and foreign files.
+ *  return
+ *          the number of failed checks
+ */
+int testPeakFile() {
+  failures = 0;
+  const string path = "testPeakFile.lpwf";
+  const string cut = "testPeakFile.cut.lpwf";
+  const int channels = 2;
+  const int64_t inputSize = 123456;
+
+  // two levels of stereo bins, the coarser one summarizes 4 bins of the finer one.
+  std::vector<PeakFile::Level> levels(2);
+  levels[0].framesPerBin = 256;
+  for (int i = 0; i < 16 * channels; i++) {
+    levels[0].bins.push_back(PeakBin{(int16_t)(-i * 10), (int16_t)(i * 20), (int16_t)(i * 5)});
+  }
+  levels[1].framesPerBin = 1024;
+  for (int i = 0; i < 4 * channels; i++) {
+    levels[1].bins.push_back(PeakBin{(int16_t)(-i * 40), (int16_t)(i * 80), (int16_t)(i * 9)});
+  }
+  check(PeakFile::save(path, 48000, channels, inputSize, 4096, levels), "save failed");
+
+  {
+    auto peaks = PeakFile::load(path, inputSize);
+    check(peaks != nullptr, "round trip: not loaded");
+    if (peaks != nullptr) {
+      check(peaks->getSampleRate() == 48000 && peaks->getChannels() == channels &&
+                peaks->getTotalFrames() == 4096 && peaks->levelCount() == 2,
+            "round trip: header differs");
+      for (size_t l = 0; l < peaks->levelCount() && l < levels.size(); l++) {
+        check(peaks->level(l).framesPerBin == levels[l].framesPerBin &&
+                  peaks->level(l).binCount * channels == levels[l].bins.size(),
+              "round trip: level " + std::to_string(l) + " differs");
+        const PeakBin* bins = peaks->bins(l);
+        bool same = true;
+        for (size_t i = 0; i < levels[l].bins.size(); i++) {
+          same = same && bins[i].min == levels[l].bins[i].min &&
+                 bins[i].max == levels[l].bins[i].max && bins[i].rms == levels[l].bins[i].rms;
+        }
+        check(same, "round trip: bins of level " + std::to_string(l) + " differ");
+      }
+      check(peaks->levelFor(100) == 0 && peaks->levelFor(512) == 0 &&
+                peaks->levelFor(1024) == 1 && peaks->levelFor(100000) == 1,
+            "levelFor picks the wrong level");
+    }
+  }
+
+  check(PeakFile::load(path, inputSize + 1) == nullptr, "a stale file is taken");
+  check(PeakFile::load(path) != nullptr, "inputSize -1 does not skip the stale check");
+  check(PeakFile::load("testPeakFile.missing.lpwf") == nullptr, "a missing file is taken");
+
+  size_t full = fileSize(path);
+  copyPrefix(path, cut, full - 1);
+  check(PeakFile::load(cut, inputSize) == nullptr, "a file without its last byte is taken");
+  copyPrefix(path, cut, sizeof(PeakFileHeader) + sizeof(PeakLevelEntry));
+  check(PeakFile::load(cut, inputSize) == nullptr, "a file without its level table is taken");
+  copyPrefix(path, cut, sizeof(PeakFileHeader) - 1);
+  check(PeakFile::load(cut, inputSize) == nullptr, "a file without its header is taken");
+
+  {
+    std::ofstream os{cut, std::ios::binary | std::ios::trunc};
+    std::vector<char> junk(full, 'x');
+    os.write(junk.data(), junk.size());
+  }
+  check(PeakFile::load(cut) == nullptr, "a file of another format is taken");
+
+  std::remove(path.c_str());
+  std::remove(cut.c_str());
+  cout << "testPeakFile: " << (failures == 0 ? "OK" : "FAILED") << ", failures=" << failures
+       << endl;
+  return failures;
+}